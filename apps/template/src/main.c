@@ -5,16 +5,15 @@
 #include "hardware.h"
 #include "print.h"
 
+/*
+ * The string is copied into the kernel transmit ring with one system call
+ */
 void p(const char* data) {
-    while (*data) {
-        u8 status;
-        do {
-            status = syscall_print_get_status();
-        } while (!status);
-
-        syscall_print_byte(*data);
-        data++;
+    u32 size = 0;
+    while (data[size]) {
+        size++;
     }
+    syscall_write(data, size);
 }
 
 int main(void) {
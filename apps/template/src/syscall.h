@@ -0,0 +1,169 @@
+/* Copyright (C) StrawberryHacker */
+
+/*
+ * Generated by tools/syscall_gen.py from kernel/src/kernel/syscall_abi.h
+ * Do not edit this file. Run the script again when the ABI changes
+ */
+
+#ifndef SYSCALL_H
+#define SYSCALL_H
+
+#include "types.h"
+
+#define SYSCALL_ABI_VERSION 3
+#define SYSCALL_ERROR 0xFFFFFFFF
+#define SYSCALL_NO_WAIT 0
+#define SYSCALL_WAIT_FOREVER 0xFFFFFFFF
+
+/*
+ * The system call number is passed in R12 and the arguments in R0-R3. A system
+ * call might run in thread mode and return through LR, so all registers the
+ * AAPCS allows a function to change are clobbered
+ */
+static inline u32 syscall_invoke(u32 nr, u32 a0, u32 a1, u32 a2, u32 a3) {
+    register u32 r0 asm("r0") = a0;
+    register u32 r1 asm("r1") = a1;
+    register u32 r2 asm("r2") = a2;
+    register u32 r3 asm("r3") = a3;
+    register u32 r12 asm("r12") = nr;
+
+    asm volatile ("svc #0"
+        : "+r" (r0), "+r" (r1), "+r" (r2), "+r" (r3), "+r" (r12)
+        :
+        : "lr", "cc", "memory"
+#ifdef __ARM_FP
+        , "d0", "d1", "d2", "d3", "d4", "d5", "d6", "d7"
+#endif
+    );
+    return r0;
+}
+
+static inline u32 syscall_abi_version(void) {
+    return syscall_invoke(0, 0, 0, 0, 0);
+}
+
+static inline void syscall_thread_sleep(u32 ms) {
+    syscall_invoke(1, (u32)ms, 0, 0, 0);
+}
+
+static inline void syscall_gpio_toggle(void* port, u32 pin) {
+    syscall_invoke(2, (u32)port, (u32)pin, 0, 0);
+}
+
+static inline void* syscall_mm_alloc(u32 size, u32 region) {
+    return (void*)syscall_invoke(3, (u32)size, (u32)region, 0, 0);
+}
+
+static inline void syscall_mm_free(void* ptr) {
+    syscall_invoke(4, (u32)ptr, 0, 0, 0);
+}
+
+static inline void syscall_print_byte(u32 data) {
+    syscall_invoke(5, (u32)data, 0, 0, 0);
+}
+
+static inline u32 syscall_print_get_status(void) {
+    return syscall_invoke(6, 0, 0, 0, 0);
+}
+
+static inline u32 syscall_read_print(char* data, u32 size) {
+    return syscall_invoke(7, (u32)data, (u32)size, 0, 0);
+}
+
+static inline void syscall_thread_yield(void) {
+    syscall_invoke(8, 0, 0, 0, 0);
+}
+
+static inline void* syscall_mutex_new(void) {
+    return (void*)syscall_invoke(9, 0, 0, 0, 0);
+}
+
+static inline u32 syscall_mutex_delete(void* mutex) {
+    return syscall_invoke(10, (u32)mutex, 0, 0, 0);
+}
+
+static inline u32 syscall_mutex_lock(void* mutex) {
+    return syscall_invoke(11, (u32)mutex, 0, 0, 0);
+}
+
+static inline u32 syscall_mutex_try_lock(void* mutex) {
+    return syscall_invoke(12, (u32)mutex, 0, 0, 0);
+}
+
+static inline u32 syscall_mutex_unlock(void* mutex) {
+    return syscall_invoke(13, (u32)mutex, 0, 0, 0);
+}
+
+static inline void* syscall_queue_new(u32 capacity, u32 msg_size, u32 msg_count) {
+    return (void*)syscall_invoke(14, (u32)capacity, (u32)msg_size, (u32)msg_count, 0);
+}
+
+static inline u32 syscall_queue_delete(void* queue) {
+    return syscall_invoke(15, (u32)queue, 0, 0, 0);
+}
+
+static inline void* syscall_msg_alloc(void* queue) {
+    return (void*)syscall_invoke(16, (u32)queue, 0, 0, 0);
+}
+
+static inline u32 syscall_msg_free(void* queue, void* msg) {
+    return syscall_invoke(17, (u32)queue, (u32)msg, 0, 0);
+}
+
+static inline u32 syscall_msg_send(void* queue, void* msg, u32 timeout) {
+    return syscall_invoke(18, (u32)queue, (u32)msg, (u32)timeout, 0);
+}
+
+static inline void* syscall_msg_receive(void* queue, u32 timeout) {
+    return (void*)syscall_invoke(19, (u32)queue, (u32)timeout, 0, 0);
+}
+
+static inline void* syscall_timer_new(void* func, void* arg) {
+    return (void*)syscall_invoke(20, (u32)func, (u32)arg, 0, 0);
+}
+
+static inline u32 syscall_timer_delete(void* timer) {
+    return syscall_invoke(21, (u32)timer, 0, 0, 0);
+}
+
+static inline u32 syscall_timer_start(void* timer, u32 delay, u32 period) {
+    return syscall_invoke(22, (u32)timer, (u32)delay, (u32)period, 0);
+}
+
+static inline u32 syscall_timer_stop(void* timer) {
+    return syscall_invoke(23, (u32)timer, 0, 0, 0);
+}
+
+static inline void* syscall_file_open(const char* path) {
+    return (void*)syscall_invoke(24, (u32)path, 0, 0, 0);
+}
+
+static inline u32 syscall_file_close(void* file) {
+    return syscall_invoke(25, (u32)file, 0, 0, 0);
+}
+
+static inline u32 syscall_file_read(void* file, void* data, u32 size) {
+    return syscall_invoke(26, (u32)file, (u32)data, (u32)size, 0);
+}
+
+static inline u32 syscall_file_write(void* file, const void* data, u32 size) {
+    return syscall_invoke(27, (u32)file, (u32)data, (u32)size, 0);
+}
+
+static inline u32 syscall_file_seek(void* file, u32 offset) {
+    return syscall_invoke(28, (u32)file, (u32)offset, 0, 0);
+}
+
+static inline u32 syscall_file_size(void* file) {
+    return syscall_invoke(29, (u32)file, 0, 0, 0);
+}
+
+static inline u32 syscall_write(const char* data, u32 size) {
+    return syscall_invoke(30, (u32)data, (u32)size, 0, 0);
+}
+
+static inline u32 syscall_mm_stats(u32 region, void* stats, u32 size) {
+    return syscall_invoke(31, (u32)region, (u32)stats, (u32)size, 0);
+}
+
+#endif
@@ -15,7 +15,9 @@ extern u32 _end;
 enum sched_class {
     REAL_TIME,
     APPLICATION,
-    BACKGROUND
+    BACKGROUND,
+    IDLE,
+    DEADLINE
 };
 
 struct app_info {
@@ -0,0 +1,785 @@
+/* Copyright (C) StrawberryHacker */
+
+/*
+ * Host scheduler simulator. The scheduler, the scheduling classes and the
+ * thread code are built for the host with the hardware access replaced by
+ * a virtual clock. A workload file describes a set of threads which are
+ * run for a fixed time, after which the wake-up latency and fairness is
+ * reported. The result only depends on the workload, so two builds of the
+ * scheduler can be compared run against run.
+ *
+ * Workload file format, one statement per line. Times are in microseconds
+ *
+ * thread <name> <class> <priority> busy
+ *     Computes forever
+ *
+ * thread <name> <class> <priority> periodic <period> <work>
+ *     Sleeps until the start of every period and computes `work`
+ *
+ * thread <name> <class> <priority> event <period> <work>
+ *     Blocks and is unblocked by a simulated interrupt every period, then
+ *     computes `work`
+ *
+ * thread <name> <class> <priority> exit <period> <work>
+ *     A new thread is made every period. It computes `work` and exits, and
+ *     is deleted by the reaper thread
+ *
+ * budget <runtime> <period>
+ *     Deadline class parameters, or background class quota, in
+ *     milliseconds of the previous thread
+ *
+ * weight <weight>
+ *     Application class weight of the previous thread
+ *
+ * run <time>
+ *     Simulated time
+ *
+ * expect latency <name> <max> [percentile]
+ *     Fails the run if the worst wake-up latency of a thread is above `max`.
+ *     If a percentile is given that percentile is checked instead
+ *
+ * expect cpu <name> <max>
+ *     Fails the run if a thread got more than `max` percent of the CPU
+ *
+ * expect fairness <min>
+ *     Fails the run if the fairness index of any group of busy threads in
+ *     the same class and priority is below `min`. The CPU time of each
+ *     thread is divided by its weight, so weighted sharing counts as fair
+ *
+ * expect reap <max>
+ *     Fails the run if an exited thread is not deleted by the reaper within
+ *     `max`, or if a new thread can not be made
+ */
+
+#include "scheduler.h"
+#include "thread.h"
+#include "systick.h"
+#include "nvic.h"
+#include "pmalloc.h"
+#include "slab.h"
+#include "mm.h"
+#include "print.h"
+#include "gpio.h"
+#include "mpu.h"
+#include "panic.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SIM_MAX_THREADS 64
+#define SIM_MAX_EXPECT  64
+#define SIM_CYCLES_US   (SYSTICK_RVR / 1000)
+
+enum sim_behaviour {
+    SIM_BUSY,
+    SIM_PERIODIC,
+    SIM_EVENT,
+    SIM_EXIT
+};
+
+struct sim_thread {
+    char name[THREAD_MAX_NAME_LEN];
+    struct thread_info info;
+    enum sim_behaviour behaviour;
+    struct thread* thread;
+    tid_t tid;
+
+    /* Period and work in cycles */
+    u64 period;
+    u64 work;
+
+    /* Work left in the current activation */
+    u64 remaining;
+
+    /* Start of the current and the next activation */
+    u64 release;
+    u64 next_release;
+
+    /* Set from the release until the thread is switched in */
+    u8 waiting;
+
+    /* Wake-up latencies in cycles */
+    u32* latency;
+    u32 latency_count;
+    u32 latency_size;
+
+    /* Activations missed because the thread was still computing */
+    u32 overruns;
+
+    /* Exiting threads deleted by the reaper, and the longest delay */
+    u32 reaped;
+    u64 reap_max;
+    u32 spawn_fails;
+
+    /*
+     * Work done by the instances which have exited. The last time slice of
+     * an exiting thread is not charged to it
+     */
+    u64 exit_cycles;
+};
+
+/*
+ * A thread which has exited and is waiting for the reaper
+ */
+struct sim_exit {
+    struct thread* thread;
+    struct sim_thread* st;
+    u64 time;
+};
+
+struct sim_expect {
+    u8 fairness;
+    u8 cpu;
+    u8 reap;
+    char name[THREAD_MAX_NAME_LEN];
+    double value;
+    u32 percentile;
+};
+
+/*
+ * Virtual hardware state shared with the stub headers
+ */
+u64 sim_time;
+volatile u8 sim_systick_pending;
+volatile u8 sim_pendsv_pending;
+
+static u32 sim_systick_rvr;
+static u64 sim_systick_start;
+static u8 sim_systick_enabled;
+
+static struct sim_thread sim_threads[SIM_MAX_THREADS];
+static u32 sim_thread_count;
+
+static struct sim_expect sim_expects[SIM_MAX_EXPECT];
+static u32 sim_expect_count;
+
+static struct sim_exit sim_exits[THREAD_TABLE_SIZE];
+static u32 sim_exit_count;
+
+static u64 sim_run_time;
+
+extern struct rq cpu_rq;
+extern struct thread* curr_thread;
+extern struct thread* next_thread;
+
+void scheduler_switch_begin(void);
+void scheduler_switch_end(void);
+void systick_exception(void);
+
+/*
+ * Virtual SysTick. Writing the CVR restarts the count down from the RVR
+ */
+void systick_set_rvr(u32 value) {
+    sim_systick_rvr = value & 0xFFFFFF;
+}
+
+void systick_set_cvr(u32 value) {
+    sim_systick_start = sim_time;
+}
+
+u32 systick_get_cvr(void) {
+    u64 elapsed = sim_time - sim_systick_start;
+    if (elapsed >= sim_systick_rvr) {
+        return 0;
+    }
+    return sim_systick_rvr - (u32)elapsed;
+}
+
+void systick_enable(u8 irq_enable) {
+    sim_systick_enabled = 1;
+    sim_systick_start = sim_time;
+}
+
+void systick_disable(void) {
+    sim_systick_enabled = 0;
+}
+
+static u64 systick_get_expiry(void) {
+    return sim_systick_start + sim_systick_rvr;
+}
+
+/*
+ * Functions used by the kernel sources which have no meaning on the host
+ */
+void* pmalloc(u32 count, enum pmalloc_bank bank) {
+    return calloc(count, 1024);
+}
+
+void pfree(void* ptr) {
+    free(ptr);
+}
+
+void mm_free(void* memory) {
+    free(memory);
+}
+
+void* slab_alloc(struct slab_cache* cache) {
+    void* obj = calloc(1, cache->obj_size);
+    if (cache->ctor) {
+        cache->ctor(obj);
+    }
+    return obj;
+}
+
+void slab_free(void* obj) {
+    free(obj);
+}
+
+/* Applications do not make kernel objects in the simulator */
+void syscall_release_thread(struct thread* thread) {}
+
+void print(const char* data, ...) {}
+
+void printl(const char* data, ...) {}
+
+void print_flush(void) {}
+
+void gpio_toggle(gpio_reg* port, u8 pin) {}
+
+void scheduler_run(void) {}
+
+u8 mpu_get_data_regions(void) {
+    return 16;
+}
+
+void mpu_configure_region(u8 reg_num, u32 addr, struct mpu_region* reg_desc) {}
+
+void mpu_move_region(u8 reg_num, u32 addr) {}
+
+void mpu_enable(void) {}
+
+void mpu_enable_priv_access(void) {}
+
+void panic_handler(const char* file_name, u32 line_number, const char* reason) {
+    fprintf(stderr, "Panic: %s:%u %s\n", file_name, line_number, reason);
+    exit(2);
+}
+
+static u64 sim_us_to_cycles(const char* value) {
+    return strtoull(value, NULL, 0) * SIM_CYCLES_US;
+}
+
+static enum sched_class sim_parse_class(const char* name) {
+    if (!strcmp(name, "DEADLINE")) {
+        return DEADLINE;
+    } else if (!strcmp(name, "REAL_TIME")) {
+        return REAL_TIME;
+    } else if (!strcmp(name, "APPLICATION")) {
+        return APPLICATION;
+    } else if (!strcmp(name, "BACKGROUND")) {
+        return BACKGROUND;
+    }
+    fprintf(stderr, "Unknown class %s\n", name);
+    exit(2);
+}
+
+static void sim_thread_entry(void* arg) {}
+
+static void sim_parse(const char* file_name) {
+    FILE* file = fopen(file_name, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Can not open %s\n", file_name);
+        exit(2);
+    }
+
+    char line[256];
+    u32 line_number = 0;
+    while (fgets(line, sizeof(line), file)) {
+        line_number++;
+
+        char* word[8];
+        u32 count = 0;
+        char* token = strtok(line, " \t\r\n");
+        while (token && (token[0] != '#') && (count < 8)) {
+            word[count++] = token;
+            token = strtok(NULL, " \t\r\n");
+        }
+        if (count == 0) {
+            continue;
+        }
+
+        if (!strcmp(word[0], "thread") && (count >= 5)) {
+            if (sim_thread_count == SIM_MAX_THREADS) {
+                fprintf(stderr, "Too many threads\n");
+                exit(2);
+            }
+            struct sim_thread* st = &sim_threads[sim_thread_count++];
+            strncpy(st->name, word[1], THREAD_MAX_NAME_LEN - 1);
+            strncpy(st->info.name, word[1], THREAD_MAX_NAME_LEN - 1);
+            st->info.stack_size = 128;
+            st->info.thread = sim_thread_entry;
+            st->info.class = sim_parse_class(word[2]);
+            st->info.priority = (u8)atoi(word[3]);
+
+            if (!strcmp(word[4], "busy")) {
+                st->behaviour = SIM_BUSY;
+            } else if (!strcmp(word[4], "periodic") && (count == 7)) {
+                st->behaviour = SIM_PERIODIC;
+            } else if (!strcmp(word[4], "event") && (count == 7)) {
+                st->behaviour = SIM_EVENT;
+            } else if (!strcmp(word[4], "exit") && (count == 7)) {
+                st->behaviour = SIM_EXIT;
+            } else {
+                fprintf(stderr, "Line %u: bad thread\n", line_number);
+                exit(2);
+            }
+            if (st->behaviour != SIM_BUSY) {
+                st->period = sim_us_to_cycles(word[5]);
+                st->work = sim_us_to_cycles(word[6]);
+            }
+        } else if (!strcmp(word[0], "budget") && (count == 3) &&
+            sim_thread_count) {
+
+            struct sim_thread* st = &sim_threads[sim_thread_count - 1];
+            st->info.runtime = (u32)atoi(word[1]);
+            st->info.period = (u32)atoi(word[2]);
+        } else if (!strcmp(word[0], "weight") && (count == 2) &&
+            sim_thread_count) {
+
+            struct sim_thread* st = &sim_threads[sim_thread_count - 1];
+            st->info.weight = (u32)atoi(word[1]);
+        } else if (!strcmp(word[0], "run") && (count == 2)) {
+            sim_run_time = sim_us_to_cycles(word[1]);
+        } else if (!strcmp(word[0], "expect") && (count >= 3) &&
+            (sim_expect_count < SIM_MAX_EXPECT)) {
+
+            struct sim_expect* e = &sim_expects[sim_expect_count++];
+            if (!strcmp(word[1], "fairness")) {
+                e->fairness = 1;
+                e->value = atof(word[2]);
+            } else if (!strcmp(word[1], "reap") && (count == 3)) {
+                e->reap = 1;
+                e->value = atof(word[2]);
+            } else if (!strcmp(word[1], "cpu") && (count == 4)) {
+                e->cpu = 1;
+                strncpy(e->name, word[2], THREAD_MAX_NAME_LEN - 1);
+                e->value = atof(word[3]);
+            } else if (!strcmp(word[1], "latency") && (count >= 4)) {
+                strncpy(e->name, word[2], THREAD_MAX_NAME_LEN - 1);
+                e->value = atof(word[3]);
+                e->percentile = (count == 5) ? (u32)atoi(word[4]) : 100;
+            } else {
+                fprintf(stderr, "Line %u: bad expect\n", line_number);
+                exit(2);
+            }
+        } else {
+            fprintf(stderr, "Line %u: bad statement\n", line_number);
+            exit(2);
+        }
+    }
+    fclose(file);
+}
+
+static struct sim_thread* sim_get_thread(struct thread* thread) {
+    if (thread == NULL) {
+        return NULL;
+    }
+    for (u32 i = 0; i < sim_thread_count; i++) {
+        if (sim_threads[i].thread == thread) {
+            return &sim_threads[i];
+        }
+    }
+    return NULL;
+}
+
+static void sim_add_latency(struct sim_thread* st, u32 latency) {
+    if (st->latency_count == st->latency_size) {
+        st->latency_size = st->latency_size ? st->latency_size * 2 : 256;
+        st->latency = realloc(st->latency, st->latency_size * sizeof(u32));
+    }
+    st->latency[st->latency_count++] = latency;
+}
+
+/*
+ * Starts a new activation of a thread
+ */
+static void sim_release(struct sim_thread* st, u64 release) {
+    if (st->waiting || st->remaining) {
+        st->overruns++;
+    }
+    st->release = release;
+    st->next_release = release + st->period;
+    st->waiting = 1;
+}
+
+/*
+ * PendSV emulation. The accounting hooks are called the same way as from
+ * the context switch
+ */
+static void sim_context_switch(void) {
+    scheduler_switch_begin();
+    curr_thread = next_thread;
+    scheduler_switch_end();
+
+    struct sim_thread* st = sim_get_thread(curr_thread);
+    if (st && st->waiting) {
+        st->waiting = 0;
+        st->remaining = st->work;
+        sim_add_latency(st, (u32)(sim_time - st->release));
+    }
+}
+
+/*
+ * Called when the running thread has finished its work
+ */
+static void sim_thread_done(struct sim_thread* st) {
+    if (st->behaviour == SIM_PERIODIC) {
+        if (st->next_release <= sim_time) {
+            /* The next activation has allready started */
+            st->overruns++;
+            st->release = st->next_release;
+            st->next_release += st->period;
+            st->remaining = st->work;
+            sim_add_latency(st, (u32)(sim_time - st->release));
+            return;
+        }
+        /* Same as `thread_sleep` but until an absolute tick */
+        st->thread->tick_to_wake = st->next_release;
+        scheduler_enqueue_delay(st->thread);
+        st->release = st->next_release;
+        st->next_release += st->period;
+        st->waiting = 1;
+        reschedule();
+    } else if (st->behaviour == SIM_EVENT) {
+        scheduler_block_thread(st->thread);
+    } else if (st->behaviour == SIM_EXIT) {
+        /*
+         * Same as `thread_exit`. The thread spins until the next tick hands
+         * it over to the reaper
+         */
+        st->thread->exit_pending = 1;
+        st->exit_cycles += st->work;
+        sim_exits[sim_exit_count].thread = st->thread;
+        sim_exits[sim_exit_count].st = st;
+        sim_exits[sim_exit_count].time = sim_time;
+        sim_exit_count++;
+        st->thread = NULL;
+    }
+}
+
+/*
+ * Makes a new instance of an exiting thread, unless the last one is still
+ * running
+ */
+static void sim_spawn(struct sim_thread* st) {
+    if (st->thread) {
+        st->overruns++;
+        st->next_release += st->period;
+        return;
+    }
+    st->tid = new_thread(&st->info);
+    if (st->tid == 0) {
+        st->spawn_fails++;
+        st->next_release += st->period;
+        return;
+    }
+    st->thread = get_thread(&cpu_rq, st->tid);
+    sim_release(st, st->next_release);
+}
+
+/*
+ * Runs one round of the reaper thread in zero time. Same as `reaper_thread`
+ */
+static void sim_reap(void) {
+    struct dlist_node* node;
+    while ((node = dlist_remove_first(&cpu_rq.zombies))) {
+        struct thread* thread = (struct thread *)node->obj;
+        thread_table_free(&cpu_rq.thread_table, thread->tid,
+            thread->exit_status);
+
+        for (u32 i = 0; i < sim_exit_count; i++) {
+            struct sim_exit* exit = &sim_exits[i];
+            if (exit->thread != thread) {
+                continue;
+            }
+            u64 delay = sim_time - exit->time;
+            if (delay > exit->st->reap_max) {
+                exit->st->reap_max = delay;
+            }
+            exit->st->reaped++;
+            *exit = sim_exits[--sim_exit_count];
+            break;
+        }
+        thread_free(thread);
+    }
+    scheduler_block_thread(cpu_rq.reaper);
+}
+
+static void sim_run(void) {
+    for (u32 i = 0; i < sim_thread_count; i++) {
+        struct sim_thread* st = &sim_threads[i];
+        if (st->behaviour == SIM_EXIT) {
+            /* Made by the first iteration of the loop */
+            st->next_release = 0;
+            continue;
+        }
+        st->tid = new_thread(&st->info);
+        if (st->tid == 0) {
+            fprintf(stderr, "Thread %s not admitted\n", st->name);
+            exit(2);
+        }
+        st->thread = get_thread(&cpu_rq, st->tid);
+
+        if (st->behaviour == SIM_BUSY) {
+            st->remaining = (u64)-1;
+        } else {
+            sim_release(st, 0);
+        }
+    }
+
+    scheduler_start();
+    sim_context_switch();
+
+    while (sim_time < sim_run_time) {
+        if (sim_systick_pending || (sim_time >= systick_get_expiry())) {
+            sim_systick_pending = 0;
+            systick_exception();
+        }
+        if (sim_pendsv_pending) {
+            sim_pendsv_pending = 0;
+            sim_context_switch();
+        }
+        if (curr_thread == cpu_rq.reaper) {
+            sim_reap();
+            continue;
+        }
+
+        /* Find the next point in time where something happens */
+        u64 next = systick_get_expiry();
+        if (sim_run_time < next) {
+            next = sim_run_time;
+        }
+        for (u32 i = 0; i < sim_thread_count; i++) {
+            struct sim_thread* st = &sim_threads[i];
+            if (((st->behaviour == SIM_EVENT) || (st->behaviour == SIM_EXIT))
+                && (st->next_release < next)) {
+                next = st->next_release;
+            }
+        }
+
+        struct sim_thread* st = sim_get_thread(curr_thread);
+        if (st && st->remaining && (sim_time + st->remaining < next)) {
+            next = sim_time + st->remaining;
+        }
+
+        /* Run the current thread until then */
+        if (st && st->remaining) {
+            st->remaining -= (next - sim_time);
+            sim_time = next;
+            if (st->remaining == 0) {
+                sim_thread_done(st);
+            }
+        } else {
+            sim_time = next;
+        }
+
+        /* Simulated interrupts unblocking the event threads */
+        for (u32 i = 0; i < sim_thread_count; i++) {
+            struct sim_thread* st = &sim_threads[i];
+            if ((st->behaviour == SIM_EVENT) && (st->next_release <= sim_time)) {
+                u8 blocked = (st->thread->rq_list == &cpu_rq.blocked_q);
+                sim_release(st, st->next_release);
+                if (blocked) {
+                    scheduler_unblock_thread_isr(st->thread);
+                }
+            }
+            if ((st->behaviour == SIM_EXIT) && (st->next_release <= sim_time)) {
+                sim_spawn(st);
+            }
+        }
+    }
+}
+
+static int sim_compare(const void* a, const void* b) {
+    u32 x = *(const u32 *)a;
+    u32 y = *(const u32 *)b;
+    return (x > y) - (x < y);
+}
+
+static double sim_cycles_to_us(u64 cycles) {
+    return (double)cycles / SIM_CYCLES_US;
+}
+
+static double sim_percentile(struct sim_thread* st, u32 percent) {
+    u32 index = (u32)(((u64)(st->latency_count - 1) * percent) / 100);
+    return sim_cycles_to_us(st->latency[index]);
+}
+
+static const char* sim_class_name(enum sched_class class) {
+    const char* names[] = {"RT", "APP", "BG", "IDLE", "DL"};
+    return names[class];
+}
+
+static u8 sim_report(void) {
+    u8 status = 1;
+    struct cpu_stats cpu;
+    scheduler_get_cpu_stats(&cpu);
+
+    printf("Simulated %.0f us, %u context switches\n\n",
+        sim_cycles_to_us(sim_time), cpu.switch_count);
+    printf("%-16s %-5s %6s %10s %10s %10s %10s %10s %8s\n", "Thread",
+        "Class", "CPU %", "Wakeups", "Min us", "P50 us", "P99 us",
+        "Max us", "Overrun");
+
+    for (u32 i = 0; i < sim_thread_count; i++) {
+        struct sim_thread* st = &sim_threads[i];
+        /* An exited thread has no statistics */
+        struct thread_stats stats;
+        memset(&stats, 0, sizeof(stats));
+        scheduler_get_thread_stats(st->tid, &stats);
+
+        double share = (100.0 * stats.cycles) / (double)sim_time;
+        if (st->behaviour == SIM_EXIT) {
+            share = (100.0 * st->exit_cycles) / (double)sim_time;
+        }
+        printf("%-16s %-5s %6.2f %10u", st->name,
+            sim_class_name(st->info.class), share, st->latency_count);
+
+        if (st->latency_count) {
+            qsort(st->latency, st->latency_count, sizeof(u32), sim_compare);
+            printf(" %10.1f %10.1f %10.1f %10.1f",
+                sim_cycles_to_us(st->latency[0]), sim_percentile(st, 50),
+                sim_percentile(st, 99),
+                sim_cycles_to_us(st->latency[st->latency_count - 1]));
+        } else {
+            printf(" %10s %10s %10s %10s", "-", "-", "-", "-");
+        }
+        printf(" %8u\n", st->overruns);
+
+        if (st->behaviour == SIM_EXIT) {
+            printf("  reaped %u - longest reap delay %.1f us - "
+                "spawn failures %u\n", st->reaped,
+                sim_cycles_to_us(st->reap_max), st->spawn_fails);
+        }
+
+        for (u32 k = 0; k < sim_expect_count; k++) {
+            struct sim_expect* e = &sim_expects[k];
+            if (e->cpu && !strcmp(st->name, e->name) && (share > e->value)) {
+                printf("FAIL %s CPU %.2f %% above %.2f %%\n", st->name,
+                    share, e->value);
+                status = 0;
+            }
+        }
+    }
+
+    /*
+     * Jain's fairness index of the weighted CPU time of busy threads
+     * competing in the same class and priority. One is perfectly fair
+     */
+    printf("\n");
+    for (u32 i = 0; i < sim_thread_count; i++) {
+        struct sim_thread* first = &sim_threads[i];
+        if (first->behaviour != SIM_BUSY) {
+            continue;
+        }
+
+        u32 n = 0;
+        u8 leader = 1;
+        double sum = 0;
+        double sum_sq = 0;
+        for (u32 j = 0; j < sim_thread_count; j++) {
+            struct sim_thread* st = &sim_threads[j];
+            if ((st->behaviour != SIM_BUSY) ||
+                (st->info.class != first->info.class) ||
+                (st->info.priority != first->info.priority)) {
+                continue;
+            }
+            if (j < i) {
+                leader = 0;
+                break;
+            }
+            struct thread_stats stats;
+            scheduler_get_thread_stats(st->tid, &stats);
+            double share = (double)stats.cycles / st->thread->weight;
+            sum += share;
+            sum_sq += share * share;
+            n++;
+        }
+        if (!leader || (n < 2)) {
+            continue;
+        }
+
+        double fairness = (sum_sq > 0) ? (sum * sum) / (n * sum_sq) : 1.0;
+        printf("Fairness %s priority %u (%u threads): %.4f\n",
+            sim_class_name(first->info.class), first->info.priority, n,
+            fairness);
+
+        for (u32 k = 0; k < sim_expect_count; k++) {
+            if (sim_expects[k].fairness && (fairness < sim_expects[k].value)) {
+                printf("FAIL fairness %.4f below %.4f\n", fairness,
+                    sim_expects[k].value);
+                status = 0;
+            }
+        }
+    }
+
+    /* Threads which have exited but are not deleted count as delayed */
+    for (u32 i = 0; i < sim_exit_count; i++) {
+        struct sim_exit* exit = &sim_exits[i];
+        u64 delay = sim_time - exit->time;
+        if (delay > exit->st->reap_max) {
+            exit->st->reap_max = delay;
+        }
+    }
+
+    for (u32 k = 0; k < sim_expect_count; k++) {
+        struct sim_expect* e = &sim_expects[k];
+        if (!e->reap) {
+            continue;
+        }
+        for (u32 i = 0; i < sim_thread_count; i++) {
+            struct sim_thread* st = &sim_threads[i];
+            if (st->behaviour != SIM_EXIT) {
+                continue;
+            }
+            if (sim_cycles_to_us(st->reap_max) > e->value) {
+                printf("FAIL %s reap delay %.1f us above %.1f us\n",
+                    st->name, sim_cycles_to_us(st->reap_max), e->value);
+                status = 0;
+            }
+            if (st->spawn_fails) {
+                printf("FAIL %s could not be made %u times\n", st->name,
+                    st->spawn_fails);
+                status = 0;
+            }
+        }
+    }
+
+    for (u32 k = 0; k < sim_expect_count; k++) {
+        struct sim_expect* e = &sim_expects[k];
+        if (e->fairness || e->cpu || e->reap) {
+            continue;
+        }
+        for (u32 i = 0; i < sim_thread_count; i++) {
+            struct sim_thread* st = &sim_threads[i];
+            if (strcmp(st->name, e->name) || (st->latency_count == 0)) {
+                continue;
+            }
+            double max = sim_percentile(st, e->percentile);
+            if (max > e->value) {
+                printf("FAIL %s P%u latency %.1f us above %.1f us\n",
+                    st->name, e->percentile, max, e->value);
+                status = 0;
+            }
+        }
+    }
+    return status;
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <workload>\n", argv[0]);
+        return 2;
+    }
+
+    sim_parse(argv[1]);
+    if (sim_run_time == 0) {
+        fprintf(stderr, "No run time given\n");
+        return 2;
+    }
+
+    sim_run();
+
+    return sim_report() ? 0 : 1;
+}
@@ -0,0 +1,35 @@
+/* Copyright (C) StrawberryHacker */
+
+#ifndef CPU_H
+#define CPU_H
+
+#include "types.h"
+
+/*
+ * Host replacement of cpu/cpu.h for the scheduler simulator. The simulator
+ * is single threaded so barriers and interrupt masking do nothing
+ */
+
+#define NOINLINE __attribute__((noinline))
+#define ALIGN(x) __attribute__((aligned((x))))
+
+static inline void dsb(void) {}
+static inline void dmb(void) {}
+static inline void isb(void) {}
+static inline void cpsie_i(void) {}
+static inline void cpsid_i(void) {}
+static inline void cpsie_f(void) {}
+static inline void cpsid_f(void) {}
+static inline u32 cpu_get_ipsr(void) { return 0; }
+static inline u32 cpu_get_primask(void) { return 0; }
+static inline void cpu_set_primask(u32 primask) {}
+
+static inline u32 cpu_clz(u32 value) {
+    return value ? (u32)__builtin_clz(value) : 32;
+}
+
+static inline u32 cpu_ctz(u32 value) {
+    return value ? (u32)__builtin_ctz(value) : 32;
+}
+
+#endif
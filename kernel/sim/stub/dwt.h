@@ -0,0 +1,21 @@
+/* Copyright (C) StrawberryHacker */
+
+#ifndef DWT_H
+#define DWT_H
+
+#include "types.h"
+
+/*
+ * Host replacement of cpu/dwt.h for the scheduler simulator. The cycle
+ * counter is the lower 32 bits of the virtual clock
+ */
+
+extern u64 sim_time;
+
+static inline void dwt_enable(void) {}
+
+static inline u32 dwt_get_cycles(void) {
+    return (u32)sim_time;
+}
+
+#endif
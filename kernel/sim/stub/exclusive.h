@@ -0,0 +1,31 @@
+/* Copyright (C) StrawberryHacker */
+
+#ifndef EXCLUSIVE_H
+#define EXCLUSIVE_H
+
+#include "types.h"
+
+/*
+ * Host replacement of cpu/exclusive.h for the scheduler simulator. The
+ * simulator is single threaded so the store never fails
+ */
+
+static inline u32 strex(volatile u32 *addr, u32 value) {
+    *addr = value;
+    return 0;
+}
+
+static inline u32 ldrex(volatile u32 *addr) {
+    return *addr;
+}
+
+static inline void* ldrex_ptr(void* volatile* addr) {
+    return *addr;
+}
+
+static inline u32 strex_ptr(void* volatile* addr, void* value) {
+    *addr = value;
+    return 0;
+}
+
+#endif
@@ -0,0 +1,48 @@
+/* Copyright (C) StrawberryHacker */
+
+#ifndef NVIC_H
+#define NVIC_H
+
+#include "types.h"
+
+/*
+ * Host replacement of cpu/nvic.h for the scheduler simulator. Pending the
+ * SysTick or PendSV exception sets a flag which the simulator main loop
+ * services before the next thread runs
+ */
+
+enum irq_priority {
+    NVIC_PRI_0,
+    NVIC_PRI_1,
+    NVIC_PRI_2,
+    NVIC_PRI_3,
+    NVIC_PRI_4,
+    NVIC_PRI_5,
+    NVIC_PRI_6,
+    NVIC_PRI_7
+};
+
+extern volatile u8 sim_systick_pending;
+extern volatile u8 sim_pendsv_pending;
+
+static inline void systick_set_priority(enum irq_priority pri) {}
+static inline void pendsv_set_priority(enum irq_priority pri) {}
+static inline void svc_set_priority(enum irq_priority pri) {}
+
+static inline void systick_set_pending(void) {
+    sim_systick_pending = 1;
+}
+
+static inline void systick_clear_pending(void) {
+    sim_systick_pending = 0;
+}
+
+static inline void pendsv_set_pending(void) {
+    sim_pendsv_pending = 1;
+}
+
+static inline void pendsv_clear_pending(void) {
+    sim_pendsv_pending = 0;
+}
+
+#endif
@@ -0,0 +1,23 @@
+/* Copyright (C) StrawberryHacker */
+
+#ifndef SYSTICK_H
+#define SYSTICK_H
+
+#include "types.h"
+
+/*
+ * Host replacement of drivers/systick.h for the scheduler simulator. The
+ * SysTick counts down on the virtual clock from the reload value
+ */
+
+void systick_set_rvr(u32 value);
+
+void systick_set_cvr(u32 value);
+
+u32 systick_get_cvr(void);
+
+void systick_enable(u8 irq_enable);
+
+void systick_disable(void);
+
+#endif
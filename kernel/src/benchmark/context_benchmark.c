@@ -0,0 +1,102 @@
+/* Copyright (C) StrawberryHacker */
+
+#include "context_benchmark.h"
+#include "scheduler.h"
+#include "thread.h"
+#include "print.h"
+#include "dwt.h"
+
+#include <stddef.h>
+
+static volatile u8 bench_fpu;
+static volatile u8 bench_started;
+static volatile u32 bench_done;
+static volatile u32 bench_switches;
+static volatile u32 bench_stamp;
+static volatile u32 bench_min;
+static volatile u32 bench_max;
+static volatile u64 bench_total;
+
+/*
+ * Used to give the workers an active floating point context
+ */
+static volatile float bench_value = 1.0f;
+
+/*
+ * Two workers with the same priority yield to each other. The time from a
+ * yield in one worker until the other worker runs is the cost of the
+ * SysTick scheduling and the PendSV context switch
+ */
+static void context_benchmark_worker(void* arg)
+{
+    while (bench_switches < CONTEXT_BENCHMARK_SWITCHES) {
+        if (bench_fpu) {
+            bench_value = bench_value * 1.0001f;
+        }
+
+        u32 now = dwt_get_cycles();
+        if (bench_started) {
+            u32 cycles = now - bench_stamp;
+            if (cycles < bench_min) {
+                bench_min = cycles;
+            }
+            if (cycles > bench_max) {
+                bench_max = cycles;
+            }
+            bench_total += cycles;
+            bench_switches++;
+        }
+        bench_started = 1;
+
+        bench_stamp = dwt_get_cycles();
+        reschedule();
+    }
+    bench_done++;
+    thread_exit();
+}
+
+static void context_benchmark_run(u8 fpu, const char* name)
+{
+    struct thread_info info = {
+        .name       = "Switch bench",
+        .stack_size = 256,
+        .thread     = context_benchmark_worker,
+        .class      = REAL_TIME,
+        .priority   = PRIO_RQ_LEVELS - 2,
+        .arg        = NULL,
+        .code_addr  = 0
+    };
+
+    bench_fpu = fpu;
+    bench_started = 0;
+    bench_done = 0;
+    bench_switches = 0;
+    bench_min = 0xFFFFFFFF;
+    bench_max = 0;
+    bench_total = 0;
+
+    new_thread(&info);
+    new_thread(&info);
+
+    while (bench_done != 2) {
+        thread_sleep(10);
+    }
+
+    u32 avg = (u32)(bench_total / CONTEXT_BENCHMARK_SWITCHES);
+    print("%s - avg: %d\t min: %d\t max: %d cycles\n", name, avg, bench_min,
+        bench_max);
+}
+
+/*
+ * Must be called from a thread with a higher priority than the workers
+ */
+void run_context_benchmark(void)
+{
+    printl("Starting context switch benchmark");
+    dwt_enable();
+
+    context_benchmark_run(0, "Integer threads");
+    context_benchmark_run(1, "FPU threads    ");
+
+    printl("Done");
+}
@@ -0,0 +1,13 @@
+/* Copyright (C) StrawberryHacker */
+
+#ifndef CONTEXT_BENCHMARK_H
+#define CONTEXT_BENCHMARK_H
+
+#include "types.h"
+
+/* Number of thread switches measured in each run */
+#define CONTEXT_BENCHMARK_SWITCHES 10000
+
+void run_context_benchmark(void);
+
+#endif
@@ -0,0 +1,98 @@
+/* Copyright (C) StrawberryHacker */
+
+#include "exit_benchmark.h"
+#include "scheduler.h"
+#include "thread.h"
+#include "mm.h"
+#include "print.h"
+#include "dwt.h"
+
+#include <stddef.h>
+
+static void* bench_fragments[EXIT_BENCHMARK_FRAGMENTS];
+static tid_t bench_tids[EXIT_BENCHMARK_THREADS];
+
+static void exit_benchmark_worker(void* arg)
+{
+    /* Returning from the thread goes through `thread_exit` */
+}
+
+/*
+ * Leaves every other block allocated, which splits the free list into many
+ * small blocks
+ */
+static void exit_benchmark_fragment(void)
+{
+    for (u32 i = 0; i < EXIT_BENCHMARK_FRAGMENTS; i++) {
+        bench_fragments[i] = mm_alloc(64, SRAM);
+    }
+    for (u32 i = 0; i < EXIT_BENCHMARK_FRAGMENTS; i += 2) {
+        mm_free(bench_fragments[i]);
+        bench_fragments[i] = NULL;
+    }
+}
+
+static void exit_benchmark_defragment(void)
+{
+    for (u32 i = 0; i < EXIT_BENCHMARK_FRAGMENTS; i++) {
+        if (bench_fragments[i]) {
+            mm_free(bench_fragments[i]);
+        }
+    }
+}
+
+/*
+ * Returns the longest SysTick handler in cycles while the given number of
+ * threads with a dynamic code segment are created and exit
+ */
+static u32 exit_benchmark_run(u32 count)
+{
+    struct thread_info info = {
+        .name       = "Exit bench",
+        .stack_size = 128,
+        .thread     = exit_benchmark_worker,
+        .class      = APPLICATION,
+        .arg        = NULL
+    };
+
+    scheduler_reset_isr_max();
+
+    for (u32 i = 0; i < count; i++) {
+        info.code_addr = (u32 *)mm_alloc(1024, SRAM);
+        bench_tids[i] = new_thread(&info);
+    }
+
+    /* Wait until all threads have exited and been deleted */
+    for (u32 i = 0; i < count; i++) {
+        u32 status;
+        while (!thread_get_exit_status(bench_tids[i], &status)) {
+            thread_sleep(1);
+        }
+    }
+    thread_sleep(10);
+
+    struct cpu_stats stats;
+    scheduler_get_cpu_stats(&stats);
+    return stats.systick_max_cycles;
+}
+
+/*
+ * Must be called from a thread with a higher priority than APPLICATION.
+ * The longest SysTick handler with exiting threads should be close to the
+ * one without, since the memory is freed by the reaper thread
+ */
+void run_exit_benchmark(void)
+{
+    printl("Starting thread exit benchmark");
+    dwt_enable();
+
+    exit_benchmark_fragment();
+
+    u32 base = exit_benchmark_run(0);
+    u32 exit = exit_benchmark_run(EXIT_BENCHMARK_THREADS);
+
+    exit_benchmark_defragment();
+
+    print("SysTick max - no exits: %d\t exits: %d cycles\n", base, exit);
+    printl("Done");
+}
@@ -0,0 +1,19 @@
+/* Copyright (C) StrawberryHacker */
+
+#ifndef EXIT_BENCHMARK_H
+#define EXIT_BENCHMARK_H
+
+#include "types.h"
+
+/* Number of exiting threads in each run */
+#define EXIT_BENCHMARK_THREADS 32
+
+/*
+ * Number of small blocks left in the free list, so freeing a thread has to
+ * walk a long free list
+ */
+#define EXIT_BENCHMARK_FRAGMENTS 256
+
+void run_exit_benchmark(void);
+
+#endif
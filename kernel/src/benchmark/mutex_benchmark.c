@@ -0,0 +1,125 @@
+/* Copyright (C) StrawberryHacker */
+
+#include "mutex_benchmark.h"
+#include "scheduler.h"
+#include "thread.h"
+#include "spinlock.h"
+#include "mutex.h"
+#include "print.h"
+#include "dwt.h"
+#include "exclusive.h"
+
+#include <stddef.h>
+
+enum mutex_benchmark_lock {
+    BENCHMARK_SPINLOCK,
+    BENCHMARK_MUTEX
+};
+
+static struct spinlock bench_spinlock;
+static struct mutex bench_mutex;
+
+static volatile enum mutex_benchmark_lock bench_lock;
+static volatile u8 bench_stop;
+static volatile u32 bench_done;
+static volatile u32 bench_count;
+static volatile u32 bench_max_latency;
+
+/*
+ * Shared data protected by the lock under test
+ */
+static volatile u32 bench_shared;
+
+static void mutex_benchmark_worker(void* arg)
+{
+    while (bench_stop == 0) {
+        u32 start = dwt_get_cycles();
+
+        if (bench_lock == BENCHMARK_SPINLOCK) {
+            spinlock_aquire(&bench_spinlock);
+        } else {
+            mutex_lock(&bench_mutex);
+        }
+
+        u32 latency = dwt_get_cycles() - start;
+        if (latency > bench_max_latency) {
+            bench_max_latency = latency;
+        }
+        bench_count++;
+
+        for (u32 i = 0; i < MUTEX_BENCHMARK_WORK; i++) {
+            bench_shared++;
+        }
+
+        if (bench_lock == BENCHMARK_SPINLOCK) {
+            spinlock_release(&bench_spinlock);
+        } else {
+            mutex_unlock(&bench_mutex);
+        }
+    }
+
+    /* The workers preempt each other, so the count is updated atomically */
+    u32 done;
+    do {
+        done = ldrex(&bench_done);
+    } while (strex(&bench_done, done + 1));
+
+    thread_exit();
+}
+
+/*
+ * Starts the workers contending on one lock and prints the number of
+ * acquisitions and the worst-case acquire latency after a fixed time
+ */
+static void mutex_benchmark_run(enum mutex_benchmark_lock lock,
+    const char* name)
+{
+    struct thread_info info = {
+        .name       = "Lock bench",
+        .stack_size = 256,
+        .thread     = mutex_benchmark_worker,
+        .class      = APPLICATION,
+        .priority   = 0,
+        .arg        = NULL,
+        .code_addr  = 0
+    };
+
+    bench_lock = lock;
+    bench_stop = 0;
+    bench_done = 0;
+    bench_count = 0;
+    bench_max_latency = 0;
+
+    for (u32 i = 0; i < MUTEX_BENCHMARK_WORKERS; i++) {
+        new_thread(&info);
+    }
+
+    thread_sleep(MUTEX_BENCHMARK_MS);
+    bench_stop = 1;
+
+    while (bench_done != MUTEX_BENCHMARK_WORKERS) {
+        thread_sleep(1);
+    }
+
+    print("%s - acquisitions: %d\t worst latency: %d cycles\n", name,
+        bench_count, bench_max_latency);
+}
+
+/*
+ * Must be called from a thread with a higher priority than APPLICATION
+ */
+void run_mutex_benchmark(void)
+{
+    printl("Starting mutex benchmark");
+
+    /* The acquire latency is measured with the DWT cycle counter */
+    dwt_enable();
+
+    spinlock_init(&bench_spinlock);
+    mutex_init(&bench_mutex);
+
+    mutex_benchmark_run(BENCHMARK_SPINLOCK, "Spinlock");
+    mutex_benchmark_run(BENCHMARK_MUTEX, "Mutex   ");
+
+    printl("Done");
+}
@@ -0,0 +1,19 @@
+/* Copyright (C) StrawberryHacker */
+
+#ifndef MUTEX_BENCHMARK_H
+#define MUTEX_BENCHMARK_H
+
+#include "types.h"
+
+/* Number of contending worker threads */
+#define MUTEX_BENCHMARK_WORKERS 4
+
+/* Length of each benchmark run in milliseconds */
+#define MUTEX_BENCHMARK_MS      2000
+
+/* Number of loop iterations spent inside the critical section */
+#define MUTEX_BENCHMARK_WORK    200
+
+void run_mutex_benchmark(void);
+
+#endif
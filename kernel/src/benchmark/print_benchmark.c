@@ -0,0 +1,105 @@
+/* Copyright (C) StrawberryHacker */
+
+#include "print_benchmark.h"
+#include "syscall.h"
+#include "scheduler.h"
+#include "thread.h"
+#include "print.h"
+#include "dwt.h"
+
+#include <stddef.h>
+
+/* System call numbers from `syscall_abi.h` */
+#define BENCH_SYS_PRINT_BYTE       5
+#define BENCH_SYS_PRINT_GET_STATUS 6
+#define BENCH_SYS_WRITE            30
+
+/*
+ * Defined in scheduler.c
+ */
+extern struct thread* curr_thread;
+
+static char bench_line[64];
+
+static u64 print_benchmark_thread_cycles(void)
+{
+    struct thread_stats stats;
+    scheduler_get_thread_stats(curr_thread->tid, &stats);
+    return stats.cycles;
+}
+
+/*
+ * Prints the time until the last byte has left the ring, and how much of
+ * that time the printing thread was running
+ */
+static void print_benchmark_report(const char* name, u32 wall, u64 cpu)
+{
+    print_flush();
+
+    /* The core clock is 300 MHz */
+    printl("%s - time: %d us\t CPU: %d %%", name, wall / 300,
+        (u32)(cpu * 100 / wall));
+}
+
+/*
+ * Two system calls per byte, spinning on the transmitter status like the
+ * old application template
+ */
+static void print_benchmark_per_byte(u32* wall, u64* cpu)
+{
+    u64 cpu_start = print_benchmark_thread_cycles();
+    u32 start = dwt_get_cycles();
+
+    for (u32 i = 0; i < PRINT_BENCHMARK_BYTES; i++) {
+        while (!syscall_invoke(BENCH_SYS_PRINT_GET_STATUS, 0, 0, 0, 0));
+        syscall_invoke(BENCH_SYS_PRINT_BYTE, bench_line[i % 64], 0, 0, 0);
+    }
+
+    *wall = dwt_get_cycles() - start;
+    *cpu = print_benchmark_thread_cycles() - cpu_start;
+}
+
+/*
+ * One system call per line into the transmit ring
+ */
+static void print_benchmark_write(u32* wall, u64* cpu)
+{
+    u64 cpu_start = print_benchmark_thread_cycles();
+    u32 start = dwt_get_cycles();
+
+    for (u32 i = 0; i < PRINT_BENCHMARK_BYTES; i += 64) {
+        syscall_invoke(BENCH_SYS_WRITE, (u32)bench_line, 64, 0, 0);
+    }
+    while (print_get_tx_pending()) {
+        thread_sleep(1);
+    }
+
+    *wall = dwt_get_cycles() - start;
+    *cpu = print_benchmark_thread_cycles() - cpu_start;
+}
+
+/*
+ * Must be called from a thread. The CPU usage is the share of the print
+ * time the thread was running instead of other threads
+ */
+void run_print_benchmark(void)
+{
+    printl("Starting print benchmark");
+    dwt_enable();
+
+    for (u32 i = 0; i < 63; i++) {
+        bench_line[i] = 'a' + (i % 26);
+    }
+    bench_line[63] = '\n';
+
+    u32 wall;
+    u64 cpu;
+
+    print_benchmark_per_byte(&wall, &cpu);
+    print_benchmark_report("Per byte", wall, cpu);
+
+    print_benchmark_write(&wall, &cpu);
+    print_benchmark_report("Write   ", wall, cpu);
+
+    printl("Done");
+}
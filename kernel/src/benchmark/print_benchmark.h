@@ -0,0 +1,13 @@
+/* Copyright (C) StrawberryHacker */
+
+#ifndef PRINT_BENCHMARK_H
+#define PRINT_BENCHMARK_H
+
+#include "types.h"
+
+/* Number of bytes printed in each run. This is larger than the TX ring */
+#define PRINT_BENCHMARK_BYTES 4096
+
+void run_print_benchmark(void);
+
+#endif
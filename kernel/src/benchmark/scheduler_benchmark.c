@@ -0,0 +1,84 @@
+/* Copyright (C) StrawberryHacker */
+
+#include "scheduler_benchmark.h"
+#include "benchmark_timer.h"
+#include "scheduler.h"
+#include "bmalloc.h"
+#include "print.h"
+#include "panic.h"
+
+#include <stddef.h>
+
+/*
+ * The benchmark runs on a private runqueue so it does not disturb the
+ * kernel scheduler. Threads are never executed, only picked and enqueued
+ */
+static struct rq bench_rq;
+static struct heap_node* bench_app_nodes[APP_RQ_SIZE];
+
+static void scheduler_benchmark_thread_init(struct thread* thread,
+    const struct scheduling_class* class, u8 priority)
+{
+    thread->rq_node.next = NULL;
+    thread->rq_node.prev = NULL;
+    thread->rq_node.obj = thread;
+    thread->rq_list = NULL;
+    thread->class = class;
+    thread->priority = priority;
+    thread->tick_to_wake = 0;
+}
+
+/*
+ * Measures the time it takes to pick the next thread and enqueue it again
+ * with `count` ready threads spread over all priority levels. This is what
+ * the SysTick handler does on every tick. Returns the time in nanoseconds
+ * per pick
+ */
+static u32 scheduler_benchmark_pick(u32 count)
+{
+    struct thread* threads = (struct thread *)bcalloc((count + 1) * 
+        sizeof(struct thread), BMALLOC_DRAM);
+
+    /* Reset the private runqueue */
+    prio_rq_init(&bench_rq.rt_rq);
+    heap_init(&bench_rq.app_rq, bench_app_nodes, APP_RQ_SIZE);
+    prio_rq_init(&bench_rq.background_rq);
+    bench_rq.class_ready = 0;
+
+    /* The idle class must allways have a thread to offer */
+    struct thread* idle = &threads[count];
+    scheduler_benchmark_thread_init(idle, &idle_class, 0);
+    idle->class->enqueue(idle, &bench_rq);
+
+    for (u32 i = 0; i < count; i++) {
+        struct thread* t = &threads[i];
+        scheduler_benchmark_thread_init(t, &rt_class, i % PRIO_RQ_LEVELS);
+        t->class->enqueue(t, &bench_rq);
+    }
+
+    benchmark_start_timer();
+    for (u32 i = 0; i < SCHEDULER_BENCHMARK_ROUNDS; i++) {
+        struct thread* t = core_scheduler(&bench_rq);
+        t->class->enqueue(t, &bench_rq);
+    }
+    benchmark_stop_timer();
+    u32 time = benchmark_get_us();
+
+    bfree(threads);
+
+    return (time * 1000) / SCHEDULER_BENCHMARK_ROUNDS;
+}
+
+void run_scheduler_benchmark(void)
+{
+    const u32 counts[] = {1, 16, 256};
+
+    printl("Starting scheduler benchmark");
+    benchmark_timer_init();
+
+    for (u32 i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+        u32 ns = scheduler_benchmark_pick(counts[i]);
+        print("Ready threads: %d\t - pick: %d ns\n", counts[i], ns);
+    }
+    printl("Done");
+}
@@ -0,0 +1,13 @@
+/* Copyright (C) StrawberryHacker */
+
+#ifndef SCHEDULER_BENCHMARK_H
+#define SCHEDULER_BENCHMARK_H
+
+#include "types.h"
+
+/* Number of pick and enqueue rounds per measurement */
+#define SCHEDULER_BENCHMARK_ROUNDS 10000
+
+void run_scheduler_benchmark(void);
+
+#endif
@@ -0,0 +1,193 @@
+/* Copyright (C) StrawberryHacker */
+
+#include "sleep_benchmark.h"
+#include "benchmark_timer.h"
+#include "scheduler.h"
+#include "dlist.h"
+#include "heap.h"
+#include "bmalloc.h"
+#include "trand.h"
+#include "print.h"
+
+#include <stddef.h>
+
+/*
+ * Compares the old sorted `dlist` sleep queue with the `heap` sleep queue.
+ * Each sleeper acts as a thread calling `thread_sleep` with a random period.
+ * The expiry part runs in the SysTick exception, so the worst case expiry
+ * time is the most important number
+ */
+struct sleeper {
+    struct dlist_node list_node;
+    struct heap_node heap_node;
+
+    u64 tick_to_wake;
+};
+
+enum sleep_benchmark_queue {
+    SLEEP_BM_LIST,
+    SLEEP_BM_HEAP
+};
+
+struct sleep_benchmark_result {
+    u32 insert_time;
+    u32 expire_time;
+    u32 expire_max;
+    u32 wake_count;
+};
+
+static struct sleeper* sleepers;
+
+static struct dlist sleep_list;
+static struct heap sleep_heap;
+static struct heap_node* sleep_heap_nodes[SLEEP_BENCHMARK_THREADS];
+
+static u64 bench_tick;
+
+/*
+ * Sorted insertion used by the scheduler before the heap was introduced
+ */
+static void sleep_list_insert(struct sleeper* s)
+{
+    struct dlist_node* iter = sleep_list.first;
+
+    while (iter != NULL) {
+        if (((struct sleeper *)iter->obj)->tick_to_wake > s->tick_to_wake) {
+            dlist_insert_before(&s->list_node, iter, &sleep_list);
+            return;
+        }
+        iter = iter->next;
+    }
+    dlist_insert_last(&s->list_node, &sleep_list);
+}
+
+/*
+ * Removes all expired sleepers from the sorted list. Returns the number of
+ * sleepers woken
+ */
+static u32 sleep_list_expire(struct sleeper** woken)
+{
+    u32 count = 0;
+    struct dlist_node* iter = sleep_list.first;
+
+    while (iter) {
+        struct sleeper* s = (struct sleeper *)iter->obj;
+        if (s->tick_to_wake > bench_tick) {
+            break;
+        }
+        iter = iter->next;
+        dlist_remove(&s->list_node, &sleep_list);
+        woken[count++] = s;
+    }
+    return count;
+}
+
+/*
+ * Removes all expired sleepers from the heap. Returns the number of sleepers
+ * woken
+ */
+static u32 sleep_heap_expire(struct sleeper** woken)
+{
+    u32 count = 0;
+    struct heap_node* first = heap_get_first(&sleep_heap);
+
+    while (first && (first->key <= bench_tick)) {
+        heap_remove_first(&sleep_heap);
+        woken[count++] = (struct sleeper *)first->obj;
+        first = heap_get_first(&sleep_heap);
+    }
+    return count;
+}
+
+/*
+ * Puts a sleeper to sleep for a random period. Returns the insertion time
+ */
+static u32 sleep_benchmark_sleep(struct sleeper* s, 
+    enum sleep_benchmark_queue queue)
+{
+    u32 ms = (trand() % SLEEP_BENCHMARK_MAX_MS) + 1;
+    s->tick_to_wake = bench_tick + (u64)ms * SYSTICK_RVR;
+
+    benchmark_start_timer();
+    if (queue == SLEEP_BM_LIST) {
+        sleep_list_insert(s);
+    } else {
+        s->heap_node.key = s->tick_to_wake;
+        heap_insert(&s->heap_node, &sleep_heap);
+    }
+    benchmark_stop_timer();
+
+    return benchmark_get_us();
+}
+
+static void sleep_benchmark_run(enum sleep_benchmark_queue queue,
+    struct sleep_benchmark_result* res)
+{
+    static struct sleeper* woken[SLEEP_BENCHMARK_THREADS];
+
+    res->insert_time = 0;
+    res->expire_time = 0;
+    res->expire_max = 0;
+    res->wake_count = 0;
+
+    dlist_init(&sleep_list);
+    heap_init(&sleep_heap, sleep_heap_nodes, SLEEP_BENCHMARK_THREADS);
+    bench_tick = 0;
+
+    for (u32 i = 0; i < SLEEP_BENCHMARK_THREADS; i++) {
+        dlist_node_init(&sleepers[i].list_node);
+        sleepers[i].list_node.obj = &sleepers[i];
+        heap_node_init(&sleepers[i].heap_node);
+        sleepers[i].heap_node.obj = &sleepers[i];
+
+        res->insert_time += sleep_benchmark_sleep(&sleepers[i], queue);
+    }
+
+    for (u32 i = 0; i < SLEEP_BENCHMARK_TICKS; i++) {
+        bench_tick += SYSTICK_RVR;
+
+        /* This part runs in the SysTick exception */
+        benchmark_start_timer();
+        u32 count;
+        if (queue == SLEEP_BM_LIST) {
+            count = sleep_list_expire(woken);
+        } else {
+            count = sleep_heap_expire(woken);
+        }
+        benchmark_stop_timer();
+        u32 time = benchmark_get_us();
+
+        res->expire_time += time;
+        if (time > res->expire_max) {
+            res->expire_max = time;
+        }
+
+        /* The woken threads go back to sleep from thread context */
+        res->wake_count += count;
+        for (u32 j = 0; j < count; j++) {
+            res->insert_time += sleep_benchmark_sleep(woken[j], queue);
+        }
+    }
+}
+
+void run_sleep_benchmark(void)
+{
+    struct sleep_benchmark_result res;
+
+    printl("Starting sleep queue benchmark");
+    benchmark_timer_init();
+
+    sleepers = (struct sleeper *)bcalloc(SLEEP_BENCHMARK_THREADS * 
+        sizeof(struct sleeper), BMALLOC_DRAM);
+
+    sleep_benchmark_run(SLEEP_BM_LIST, &res);
+    print("List - insert: %d us\texpire: %d us\tmax: %d us\twakes: %d\n",
+        res.insert_time, res.expire_time, res.expire_max, res.wake_count);
+
+    sleep_benchmark_run(SLEEP_BM_HEAP, &res);
+    print("Heap - insert: %d us\texpire: %d us\tmax: %d us\twakes: %d\n",
+        res.insert_time, res.expire_time, res.expire_max, res.wake_count);
+
+    bfree(sleepers);
+    printl("Done");
+}
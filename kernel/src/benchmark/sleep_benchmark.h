@@ -0,0 +1,17 @@
+/* Copyright (C) StrawberryHacker */
+
+#ifndef SLEEP_BENCHMARK_H
+#define SLEEP_BENCHMARK_H
+
+#include "types.h"
+
+/* Number of sleeping threads and the maximum sleep period in milliseconds */
+#define SLEEP_BENCHMARK_THREADS 1000
+#define SLEEP_BENCHMARK_MAX_MS  1000
+
+/* Number of simulated SysTick periods */
+#define SLEEP_BENCHMARK_TICKS   5000
+
+void run_sleep_benchmark(void);
+
+#endif
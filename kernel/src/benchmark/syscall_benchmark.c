@@ -0,0 +1,85 @@
+/* Copyright (C) StrawberryHacker */
+
+#include "syscall_benchmark.h"
+#include "syscall.h"
+#include "mutex.h"
+#include "print.h"
+#include "dwt.h"
+
+#include <stddef.h>
+
+/* System call numbers from `syscall_abi.h` */
+#define BENCH_SYS_ABI_VERSION  0
+#define BENCH_SYS_MUTEX_NEW    9
+#define BENCH_SYS_MUTEX_DELETE 10
+#define BENCH_SYS_MUTEX_LOCK   11
+#define BENCH_SYS_MUTEX_UNLOCK 13
+
+static struct mutex bench_mutex;
+
+/*
+ * Prints the average, minimum and maximum cycles of the samples taken by a
+ * run. The cost of reading the cycle counter is subtracted
+ */
+static void syscall_benchmark_print(const char* name, u64 total, u32 min,
+    u32 max, u32 overhead)
+{
+    u32 avg = (u32)(total / SYSCALL_BENCHMARK_CALLS);
+    print("%s - avg: %d\t min: %d\t max: %d cycles\n", name,
+        avg - overhead, min - overhead, max - overhead);
+}
+
+#define SYSCALL_BENCHMARK_RUN(name, overhead, call) do { \
+    u64 total = 0;                                        \
+    u32 min = 0xFFFFFFFF;                                 \
+    u32 max = 0;                                          \
+    for (u32 i = 0; i < SYSCALL_BENCHMARK_CALLS; i++) {   \
+        u32 start = dwt_get_cycles();                     \
+        call;                                             \
+        u32 cycles = dwt_get_cycles() - start;            \
+        total += cycles;                                  \
+        if (cycles < min) {                               \
+            min = cycles;                                 \
+        }                                                 \
+        if (cycles > max) {                               \
+            max = cycles;                                 \
+        }                                                 \
+    }                                                     \
+    syscall_benchmark_print(name, total, min, max, overhead); \
+} while (0)
+
+/*
+ * Measures the round trip of a system call handled in the SVC handler, and
+ * of a system call run in thread mode, against calling the kernel directly.
+ * Should be called from a thread, since the SVC can not be taken from an
+ * exception handler of the same or higher priority
+ */
+void run_syscall_benchmark(void)
+{
+    printl("Starting syscall benchmark");
+    dwt_enable();
+
+    u32 start = dwt_get_cycles();
+    u32 overhead = dwt_get_cycles() - start;
+
+    SYSCALL_BENCHMARK_RUN("Empty             ", overhead, );
+
+    SYSCALL_BENCHMARK_RUN("Handler syscall   ", overhead,
+        syscall_invoke(BENCH_SYS_ABI_VERSION, 0, 0, 0, 0));
+
+    mutex_init(&bench_mutex);
+    SYSCALL_BENCHMARK_RUN("Direct lock/unlock", overhead,
+        mutex_lock(&bench_mutex); mutex_unlock(&bench_mutex));
+
+    u32 mutex = syscall_invoke(BENCH_SYS_MUTEX_NEW, 0, 0, 0, 0);
+    if (mutex == 0) {
+        printl("Can not make mutex");
+        return;
+    }
+    SYSCALL_BENCHMARK_RUN("Thread mode lock  ", overhead,
+        syscall_invoke(BENCH_SYS_MUTEX_LOCK, mutex, 0, 0, 0);
+        syscall_invoke(BENCH_SYS_MUTEX_UNLOCK, mutex, 0, 0, 0));
+    syscall_invoke(BENCH_SYS_MUTEX_DELETE, mutex, 0, 0, 0);
+
+    printl("Done");
+}
@@ -0,0 +1,13 @@
+/* Copyright (C) StrawberryHacker */
+
+#ifndef SYSCALL_BENCHMARK_H
+#define SYSCALL_BENCHMARK_H
+
+#include "types.h"
+
+/* Number of system calls in each run */
+#define SYSCALL_BENCHMARK_CALLS 10000
+
+void run_syscall_benchmark(void);
+
+#endif
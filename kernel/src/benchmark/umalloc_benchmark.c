@@ -12,6 +12,14 @@
 
 #define UMALLOC_SIZE 1000
 
+/*
+ * The large case fills an arena of this many blocks. The old linear bitmap
+ * search was slowest when the only free blocks were at the end
+ */
+#define UMALLOC_LARGE_SIZE 4096
+#define UMALLOC_LARGE_ROUNDS 1024
+#define UMALLOC_LARGE_STRIDE 1597
+
 /* Pointer pool for the bmalloc */
 static u32 pointer_pool[UMALLOC_SIZE];
 
@@ -93,9 +101,56 @@ static u32 ufree_random(void)
     return return_value;
 }
 
+static u32 large_pool[UMALLOC_LARGE_SIZE];
+
+/*
+ * Prints the time per allocation and free in a 4096 block arena. The arena is
+ * filled, and then blocks spread over the whole arena are freed and allocated
+ * again. The timer counts microseconds, so the blocks are timed in batches
+ */
+static void umalloc_benchmark_large(void)
+{
+    struct umalloc_desc large;
+    umalloc_new(&large, 16, UMALLOC_LARGE_SIZE, PMALLOC_BANK_2);
+
+    /* Fill the arena */
+    benchmark_start_timer();
+    for (u32 i = 0; i < UMALLOC_LARGE_SIZE; i++) {
+        large_pool[i] = (u32)umalloc(&large);
+    }
+    benchmark_stop_timer();
+    u32 fill_us = benchmark_get_us();
+
+    /* An odd stride visits different blocks all over the arena */
+    benchmark_start_timer();
+    for (u32 i = 0; i < UMALLOC_LARGE_ROUNDS; i++) {
+        u32 index = (i * UMALLOC_LARGE_STRIDE) % UMALLOC_LARGE_SIZE;
+        ufree(&large, (u32 *)large_pool[index]);
+    }
+    benchmark_stop_timer();
+    u32 free_us = benchmark_get_us();
+
+    /* Allocate the blocks again while the arena is almost full */
+    benchmark_start_timer();
+    for (u32 i = 0; i < UMALLOC_LARGE_ROUNDS; i++) {
+        u32 index = (i * UMALLOC_LARGE_STRIDE) % UMALLOC_LARGE_SIZE;
+        large_pool[index] = (u32)umalloc(&large);
+    }
+    benchmark_stop_timer();
+    u32 alloc_us = benchmark_get_us();
+
+    umalloc_delete(&large);
+
+    print("4096 blocks - fill: %d ns\n", fill_us * 1000 / UMALLOC_LARGE_SIZE);
+    print("4096 blocks - alloc: %d ns free: %d ns\n",
+        alloc_us * 1000 / UMALLOC_LARGE_ROUNDS,
+        free_us * 1000 / UMALLOC_LARGE_ROUNDS);
+}
+
 void run_umalloc_benchmark(void)
 {
     umalloc_benchmark_init();
+    umalloc_benchmark_large();
 
     u32 count = 0;
 
@@ -6,9 +6,35 @@
 #include "print.h"
 #include "clock.h"
 #include "nvic.h"
+#include "workqueue.h"
+#include "scheduler.h"
 
 static struct list_node button_list;
 
+/*
+ * The callbacks are deferred to the system workqueue, so they run in thread
+ * context and may block or print. Each edge queues the work item for its
+ * event, so a quick press and release runs both
+ */
+static struct work button_pressed_work;
+static struct work button_released_work;
+
+static void button_run_callbacks(void* arg)
+{
+    enum button_event event = (enum button_event)(u32)arg;
+
+    struct list_node* node;
+    list_iterate(node, &button_list) {
+
+        struct button_callback* cb =
+            list_get_entry(node, struct button_callback, node);
+
+        if ((cb->event == event) || (cb->event == BUTTON_EVENT)) {
+            cb->callback();
+        }
+    }
+}
+
 void button_init(void)
 {
     /* Configure the on board button */
@@ -21,6 +47,11 @@ void button_init(void)
 	nvic_enable(10);
 
     list_init(&button_list);
+
+    work_init(&button_pressed_work, button_run_callbacks,
+        (void *)(u32)BUTTON_PRESSED, 0);
+    work_init(&button_released_work, button_run_callbacks,
+        (void *)(u32)BUTTON_RELEASED, 0);
 }
 
 void button_add_callback(struct button_callback* handler)
@@ -30,23 +61,18 @@ void button_add_callback(struct button_callback* handler)
 
 void gpioa_exception(void)
 {
+    scheduler_isr_enter();
+
 	gpio_get_interrupt_status(GPIOA);
 
     /* Edge detection is on */
     u8 pin_level = (GPIOA->PDSR & (1 << 11)) ? 1 : 0;
-	
-    struct list_node* node;
-    list_iterate(node, &button_list) {
 
-        struct button_callback* cb =
-            list_get_entry(node, struct button_callback, node);
-
-        if ((cb->event == BUTTON_PRESSED) && (pin_level == 1)) {
-            continue;
-        }
-        if ((cb->event == BUTTON_RELEASED) && (pin_level == 0)) {
-            continue;    
-        }
-        cb->callback();
+    if (pin_level == 0) {
+        queue_work(&system_wq, &button_pressed_work);
+    } else {
+        queue_work(&system_wq, &button_released_work);
     }
+
+    scheduler_isr_exit();
 }
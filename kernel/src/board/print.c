@@ -7,19 +7,61 @@
 #include "sprint.h"
 #include "nvic.h"
 #include "ringbuffer.h"
+#include "scheduler.h"
+#include "exclusive.h"
+#include "dlist.h"
+#include "cpu.h"
 
 #include <stdarg.h>
+#include <stddef.h>
 
 /*
- * The `sprint` formatter functions will output the result to this
- * buffer. This buffer sets the maximum print limit supported by the
- * system
+ * Defined in scheduler.c
  */
-static char debug_buffer[64];
+extern struct thread* curr_thread;
+
 static char receive_buffer[256];
 
 struct ringbuffer rb;
 
+/*
+ * Console transmit ring drained by the USART1 TXRDY interrupt. Any thread
+ * or exception handler can print. A producer copies at most
+ * `PRINT_TX_CHUNK` bytes into the ring and moves `tx_head` with interrupts
+ * disabled, so a producer which is preempted, killed or starved never holds
+ * back the output of the others. The indexes are free running, so the ring
+ * is full when they differ by the ring size
+ */
+static u8 tx_buffer[PRINT_TX_SIZE];
+static volatile u32 tx_head;
+static volatile u32 tx_tail;
+
+/* Largest copy done with interrupts disabled. This holds one `printl` */
+#define PRINT_TX_CHUNK (PRINT_FORMAT_SIZE + 1)
+
+/* Number of bytes dropped with the PRINT_OVERFLOW_DROP policy */
+static volatile u32 tx_dropped;
+
+/* Set by `print_sync`. All output is written directly to the USART */
+static volatile u8 tx_sync;
+
+/* Threads waiting for room in the transmit ring */
+static struct dlist tx_wait_q;
+
+/* Threads waiting in `print_flush` for the transmit ring to be empty */
+static struct dlist tx_flush_q;
+
+/*
+ * A waiting thread places this on its own stack. `woken` is set by the
+ * interrupt when it removes the waiter from the wait list
+ */
+struct print_waiter {
+    struct thread* thread;
+    volatile u8 woken;
+
+    struct dlist_node node;
+};
+
 /*
  * Initializes the system serial port USART1 with the following configuration
  *
@@ -61,16 +103,167 @@ void print_init(void) {
  * Deinitializes the serial port USART1 for soft reset support
  */
 void print_deinit(void) {
+    print_flush();
 	usart_deinit(USART1);
     peripheral_clock_disable(14);
 	nvic_disable(14);
 	nvic_clear_pending(14);
 }
 
+/*
+ * Defined in scheduler.c
+ */
+extern volatile u8 scheduler_status;
+
+/*
+ * Returns 1 if the caller is a thread which can be blocked. A thread can
+ * not block while the scheduler is suspended, since it is never woken
+ */
+static u8 print_can_block(void) {
+    return (curr_thread && scheduler_status && (cpu_get_ipsr() == 0) &&
+        (cpu_get_primask() == 0)) ? 1 : 0;
+}
+
+/*
+ * Wakes all the threads in a wait list. This MUST be called with interrupts
+ * disabled or from the USART1 interrupt
+ */
+static void print_wake(struct dlist* list) {
+    struct dlist_node* node;
+    while ((node = dlist_remove_first(list))) {
+        struct print_waiter* waiter = (struct print_waiter *)node->obj;
+        waiter->woken = 1;
+        waiter->thread->wait_list = NULL;
+        scheduler_unblock_thread_isr(waiter->thread);
+    }
+}
+
+/*
+ * Blocks the current thread on a wait list until it is woken by the
+ * interrupt. This MUST be called with interrupts disabled, and they are
+ * disabled again on return
+ */
+static void print_block(struct dlist* list) {
+    struct print_waiter waiter;
+    waiter.thread = curr_thread;
+    waiter.woken = 0;
+    dlist_node_init(&waiter.node);
+    waiter.node.obj = &waiter;
+
+    dlist_insert_last(&waiter.node, list);
+    curr_thread->wait_list = list;
+    curr_thread->wait_entry = &waiter.node;
+    scheduler_block_thread(curr_thread);
+
+    /* The context switch happens here */
+    cpsie_i();
+    cpsid_i();
+
+    if (!waiter.woken) {
+        dlist_remove(&waiter.node, list);
+        curr_thread->wait_list = NULL;
+    }
+}
+
+/*
+ * Sends the committed bytes in the transmit ring by polling the USART. This
+ * is used when the TXRDY interrupt can not run
+ */
+static void print_tx_poll(void) {
+    u32 primask = cpu_get_primask();
+    cpsid_i();
+
+    u32 tail = tx_tail;
+    while (tail != tx_head) {
+        usart_write(USART1, tx_buffer[tail++ & (PRINT_TX_SIZE - 1)]);
+    }
+    tx_tail = tail;
+    usart_interrupt_disable(USART1, USART_IRQ_TXRDY);
+
+    /* The interrupt will not run, so it can not wake the waiting threads */
+    print_wake(&tx_wait_q);
+    print_wake(&tx_flush_q);
+
+    cpu_set_primask(primask);
+}
+
+/*
+ * Waits until there might be room for `size` bytes in the transmit ring. A
+ * thread is blocked until the interrupt has sent half the ring. Other
+ * callers can not wait for the interrupt and send the ring by polling.
+ * Returns 0 if no room can be made
+ */
+static u8 print_tx_wait(u32 size) {
+    if (print_can_block()) {
+        cpsid_i();
+        if ((tx_head + size - tx_tail) > PRINT_TX_SIZE) {
+            print_block(&tx_wait_q);
+        }
+        cpsie_i();
+    } else if ((cpu_get_ipsr() == 0) && (cpu_get_primask() == 0)) {
+        /* The scheduler is not running or suspended, but the interrupt is */
+        while ((tx_head + size - tx_tail) > PRINT_TX_SIZE);
+    } else {
+        u32 tail = tx_tail;
+        print_tx_poll();
+        return (tail != tx_tail) ? 1 : 0;
+    }
+    return 1;
+}
+
+/*
+ * Places `size` bytes in the transmit ring. If the ring is full the bytes
+ * are dropped if `may_drop` is set. Otherwise the caller waits for room.
+ * Data up to `PRINT_TX_CHUNK` bytes is never mixed with output from other
+ * callers
+ */
+static void print_out(const char* data, u32 size, u8 may_drop) {
+    if (tx_sync) {
+        while (size--) {
+            usart_write(USART1, *data++);
+        }
+        return;
+    }
+
+    while (size) {
+        u32 chunk = (size > PRINT_TX_CHUNK) ? PRINT_TX_CHUNK : size;
+
+        u32 primask = cpu_get_primask();
+        cpsid_i();
+
+        u32 head = tx_head;
+        if ((head + chunk - tx_tail) > PRINT_TX_SIZE) {
+            cpu_set_primask(primask);
+
+            if (may_drop || !print_tx_wait(chunk)) {
+                u32 dropped;
+                do {
+                    dropped = ldrex(&tx_dropped);
+                } while (strex(&tx_dropped, dropped + size));
+                return;
+            }
+            continue;
+        }
+
+        for (u32 i = 0; i < chunk; i++) {
+            tx_buffer[(head + i) & (PRINT_TX_SIZE - 1)] = *data++;
+        }
+
+        /* The data must be in the ring before the interrupt can see it */
+        dmb();
+        tx_head = head + chunk;
+        usart_interrupt_enable(USART1, USART_IRQ_TXRDY);
+
+        cpu_set_primask(primask);
+        size -= chunk;
+    }
+}
+
 /*
  * Serial port USART1 formatted printing
  */
 void print(const char* data, ...) {
+    char buffer[PRINT_FORMAT_SIZE];
     va_list obj;
 
     /*
@@ -79,20 +272,17 @@ void print(const char* data, ...) {
      * precedes the (...)
      */
     va_start(obj, data);
-    u32 size = print_to_buffer_va(debug_buffer, data, obj);
+    u32 size = print_to_buffer_va(buffer, data, obj);
     va_end(obj);
 
-    /* Transmit the formated buffer */
-    const char* src = debug_buffer;
-    while (size--) {
-        usart_write(USART1, *src++);
-    }
+    print_out(buffer, size, PRINT_OVERFLOW_DROP);
 }
 
 /*
  * Serial port USART1 formatted printing with an automatic new line
  */
 void printl(const char* data, ...) {
+    char buffer[PRINT_FORMAT_SIZE + 1];
     va_list obj;
 
     /*
@@ -101,24 +291,22 @@ void printl(const char* data, ...) {
      * precedes the (...)
      */
     va_start(obj, data);
-    u32 size = print_to_buffer_va(debug_buffer, data, obj);
+    u32 size = print_to_buffer_va(buffer, data, obj);
     va_end(obj);
 
-    /* Transmit the formated buffer */
-    const char* src = debug_buffer;
-    while (size--) {
-        usart_write(USART1, *src++);
-    }
-    usart_write(USART1, '\n');
+    buffer[size++] = '\n';
+    print_out(buffer, size, PRINT_OVERFLOW_DROP);
 }
 
 /*
  * Prints a raw string without any formatting
  */
 void print_raw(const char* data) {
-    while (*data) {
-        usart_write(USART1, *data++);
+    u32 size = 0;
+    while (data[size]) {
+        size++;
     }
+    print_out(data, size, PRINT_OVERFLOW_DROP);
 }
 
 /*
@@ -151,22 +339,68 @@ void print_memory(const u32* memory, u32 size) {
 }
 
 /*
- * Flushes the USART1 transmit buffer. The `serial_print` only
- * checks the transmitter status before the THR write, not after.
- * If the user depends on the characters beeing transmitted before
- * proceeding this function can be called
+ * Flushes the USART1 transmit buffer. Printing only places the data
+ * in the transmit ring. If the user depends on the characters beeing
+ * transmitted before proceeding this function can be called. A thread is
+ * blocked until the interrupt has emptied the ring. Only exception handlers
+ * and callers with interrupts disabled send the ring by polling, since that
+ * keeps interrupts disabled for as long as the ring takes to send
  */
 void print_flush(void) {
+    if (print_can_block()) {
+        cpsid_i();
+        while (tx_tail != tx_head) {
+            print_block(&tx_flush_q);
+        }
+        cpsie_i();
+    } else if ((cpu_get_ipsr() == 0) && (cpu_get_primask() == 0)) {
+        /* The scheduler is not running or suspended, but the interrupt is */
+        while (tx_tail != tx_head);
+    } else {
+        print_tx_poll();
+    }
 	usart_flush(USART1);
 }
 
+/*
+ * Sends all buffered output and makes all further output synchronous. This
+ * is used by the panic and fault handlers, which must get their output
+ * through no matter the state of the system
+ */
+void print_sync(void) {
+    tx_sync = 1;
+    print_tx_poll();
+}
+
+/*
+ * Copies `size` bytes into the transmit ring and returns. The bytes are
+ * sent by the USART1 interrupt. A thread is only blocked while the ring
+ * is full. Returns the number of bytes written
+ */
+u32 print_write(const char* data, u32 size) {
+    print_out(data, size, 0);
+    return size;
+}
+
+/*
+ * Returns the number of bytes in the transmit ring
+ */
+u32 print_get_tx_pending(void) {
+    return tx_head - tx_tail;
+}
+
+/*
+ * Returns the number of bytes dropped because the transmit ring was full
+ */
+u32 print_get_dropped(void) {
+    return tx_dropped;
+}
+
 /*
  * Print `count` number of characters from the specified string
  */
 void print_count(const char* data, u32 count) {
-    while (count--) {
-        usart_write(USART1, *data++);
-    }
+    print_out(data, count, PRINT_OVERFLOW_DROP);
 }
 
 /*
@@ -174,15 +408,14 @@ void print_count(const char* data, u32 count) {
  * The user must check for the print status before calling this
  */
 void print_byte(u8 data) {
-    usart_write_raw(USART1, data);
+    print_out((const char *)&data, 1, 0);
 }
 
 /*
- * Check the THR status. Returns 1 if the transmit buffer is ready for
- * new data
+ * Check the transmit ring. Returns 1 if there is room for new data
  */
 u8 print_get_status(void) {
-    return usart_get_thr_status(USART1);
+    return (print_get_tx_pending() < PRINT_TX_SIZE) ? 1 : 0;
 }
 
 /*  
@@ -211,12 +444,41 @@ void print_register(const char* name, u32 reg)
 
 /*
  * Interrupt exeption is called when a new character is
- * available in the reive holding register
+ * available in the reive holding register, or when the transmitter
+ * can take the next character from the transmit ring
  */
 void usart1_exception(void) {
+    scheduler_isr_enter();
+
+    u32 status = usart_get_interrupt_status(USART1);
+
+    if (status & USART_IRQ_RXRDY) {
+        /* Read the RHR to clear the interrupt flag */
+        u8 rec = usart_read(USART1);
+
+        ringbuffer_add(&rb, rec);
+    }
+
+    if (status & USART_IRQ_TXRDY) {
+        u32 tail = tx_tail;
+        if (tail != tx_head) {
+            usart_write_raw(USART1, tx_buffer[tail++ & (PRINT_TX_SIZE - 1)]);
+            tx_tail = tail;
+        }
+
+        /* TXRDY stays set while the THR is empty */
+        if (tail == tx_head) {
+            usart_interrupt_disable(USART1, USART_IRQ_TXRDY);
+        }
 
-    /* Read the RHR to clear the interrupt flag */
-    u8 rec = usart_read(USART1);
+        /* Waiting threads are woken when half the ring is free */
+        if (tx_wait_q.first && ((tx_head - tail) <= PRINT_TX_SIZE / 2)) {
+            print_wake(&tx_wait_q);
+        }
+        if (tx_flush_q.first && (tail == tx_head)) {
+            print_wake(&tx_flush_q);
+        }
+    }
 
-    ringbuffer_add(&rb, rec);
+    scheduler_isr_exit();
 }
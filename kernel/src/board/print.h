@@ -14,6 +14,20 @@
 #define ANSI_YELLOW  "\033[33m"
 #define ANSI_CYAN    "\033[36m"
 
+/* Size of the transmit ring in bytes. Must be a power of two */
+#define PRINT_TX_SIZE 4096
+
+/* Maximum length of one formatted print */
+#define PRINT_FORMAT_SIZE 64
+
+/*
+ * Overflow policy of `print`, `printl` and `print_raw` when the transmit
+ * ring is full. If set the output is dropped and counted, so printing never
+ * delays the caller. Otherwise the caller waits for room. Data written with
+ * `print_write` is never dropped
+ */
+#define PRINT_OVERFLOW_DROP 0
+
 void print_init(void);
 
 void print_deinit(void);
@@ -38,4 +52,12 @@ void print_register(const char* name, u32 reg);
 
 u32 read_print_buffer(char* data, u32 size);
 
+u32 print_write(const char* data, u32 size);
+
+u32 print_get_tx_pending(void);
+
+u32 print_get_dropped(void);
+
+void print_sync(void);
+
 #endif
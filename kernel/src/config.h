@@ -4,6 +4,7 @@
 #define CONFIG_H
 
 /* USB stuff */
+#define URB_SLAB_OBJECTS 32
 #define URB_MAX_COUNT 256
 #define URB_ALLOCATOR_BANK PMALLOC_BANK_2
 
@@ -12,4 +13,21 @@
 /* Describes the maximum size of the USB product and manufaturer string */
 #define USB_DEV_NAME_MAX_SIZE 64
 
+/*
+ * USB devices and their descriptors are allocated from slab caches, which
+ * hold at least USB_DEV_MAX_COUNT of each. A device with a larger descriptor
+ * set than USB_DESC_CACHE_SIZE, or added when the caches are empty, uses
+ * bmalloc instead
+ */
+#define USB_SLAB_OBJECTS 4
+#define USB_DEV_MAX_COUNT 16
+#define USB_DESC_CACHE_SIZE 512
+#define USB_CACHE_BANK PMALLOC_BANK_2
+
+/* Number of mutexes, queues, timers and files applications can have open */
+#define SYS_HANDLE_COUNT 64
+
+/* Message queue buffer pools */
+#define MSG_POOL_BANK PMALLOC_BANK_2
+
 #endif
\ No newline at end of file
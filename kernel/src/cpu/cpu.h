@@ -57,6 +57,31 @@ static inline void cpsid_f(void) {
 	asm volatile ("cpsid f" : : : "memory");
 }
 
+/*
+ * Gets the number of the active exception. Returns 0 in thread mode
+ */
+static inline u32 cpu_get_ipsr(void) {
+	u32 ipsr;
+	asm volatile ("mrs %0, ipsr" : "=r"(ipsr));
+	return ipsr;
+}
+
+/*
+ * Gets the interrupt mask set by `cpsid_i`
+ */
+static inline u32 cpu_get_primask(void) {
+	u32 primask;
+	asm volatile ("mrs %0, primask" : "=r"(primask));
+	return primask;
+}
+
+/*
+ * Restores an interrupt mask read by `cpu_get_primask`
+ */
+static inline void cpu_set_primask(u32 primask) {
+	asm volatile ("msr primask, %0" : : "r"(primask) : "memory");
+}
+
 /*
  * Sets the interrupt base priority
  */
@@ -73,6 +98,25 @@ static inline u32 cpu_get_basepri(void) {
 	return basepri;
 }
 
+/*
+ * Counts the leading zeros in `value`. Returns 32 if `value` is zero
+ */
+static inline u32 cpu_clz(u32 value) {
+	u32 res;
+	asm ("clz %0, %1" : "=r"(res) : "r"(value));
+	return res;
+}
+
+/*
+ * Counts the trailing zeros in `value`. Returns 32 if `value` is zero
+ */
+static inline u32 cpu_ctz(u32 value) {
+	u32 res;
+	asm ("rbit %0, %1\n\t"
+	     "clz %0, %0" : "=r"(res) : "r"(value));
+	return res;
+}
+
 /*
  * Gets the interrupt base priority
  */
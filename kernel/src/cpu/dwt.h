@@ -0,0 +1,34 @@
+/* Copyright (C) StrawberryHacker */
+
+#ifndef DWT_H
+#define DWT_H
+
+#include "types.h"
+#include "cpu.h"
+
+/*
+ * The Data Watchpoint and Trace unit contains a 32-bit cycle counter
+ * (CYCCNT) running at the CPU clock. It wraps around every 14 seconds at
+ * 300 MHz, so differences between two readings must be computed with
+ * unsigned 32-bit arithmetic. The DWT is enabled through the TRCENA bit
+ * in the DEMCR register
+ */
+#define DWT_DEMCR  (*(volatile u32 *)0xE000EDFC)
+#define DWT_CTRL   (*(volatile u32 *)0xE0001000)
+#define DWT_CYCCNT (*(volatile u32 *)0xE0001004)
+
+/*
+ * Enables and resets the cycle counter
+ */
+static inline void dwt_enable(void) {
+    DWT_DEMCR |= (1 << 24);
+    DWT_CYCCNT = 0;
+    DWT_CTRL |= (1 << 0);
+    dsb();
+}
+
+static inline u32 dwt_get_cycles(void) {
+    return DWT_CYCCNT;
+}
+
+#endif
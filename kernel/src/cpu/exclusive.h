@@ -34,4 +34,25 @@ static inline u32 ldrex(volatile u32 *addr) {
     return result;
 }
 
+/*
+ * Pointer versions of LDREX and STREX used by lock-free lists
+ */
+static inline void* ldrex_ptr(void* volatile* addr) {
+    void* result;
+
+    asm volatile (
+        "ldrex %0, %1"
+        : "=r" (result) : "Q" (*addr) : "memory");
+    return result;
+}
+
+static inline u32 strex_ptr(void* volatile* addr, void* value) {
+    uint32_t result;
+
+    asm volatile (
+        "strex %0, %2, %1"
+        : "=&r" (result), "=Q" (*addr) : "r" (value) : "memory");
+    return result;
+}
+
 #endif
@@ -39,4 +39,16 @@ static inline void fpu_enable() {
     isb();
 }
 
+/*
+ * Enables automatic state preservation with lazy stacking. The CPU sets
+ * CONTROL.FPCA on the first floating point instruction in a context, and
+ * only reserves stack space for S0-S15 and FPSCR on exception entry. The
+ * registers are stacked if the exception handler uses the FPU itself
+ */
+static inline void fpu_lazy_stacking_enable() {
+    *(volatile u32 *)0xE000EF34 |= (1 << 31) | (1 << 30);
+    dsb();
+    isb();
+}
+
 #endif
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include "print.h"
 #include "sd.h"
 #include "mm.h"
+#include "bmalloc.h"
 #include "panic.h"
 #include "syscall.h"
 
@@ -918,7 +919,7 @@ u8 disk_mount(enum disk disk) {
 				
 				// Allocate the file system structure in internal SRAM
 				struct volume* vol = (struct volume *)
-					mm_alloc(sizeof(struct volume), SRAM);
+					bcalloc(sizeof(struct volume), BMALLOC_SRAM);
 				
 				// Update FAT32 information
 				vol->sector_size = fat_load16(mount_buffer + BPB_SECTOR_SIZE);
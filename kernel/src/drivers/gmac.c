@@ -2,6 +2,8 @@
 #include "hardware.h"
 #include "cpu.h"
 #include "print.h"
+#include "workqueue.h"
+#include "scheduler.h"
 
 #define GMAC_TX_BUFFER_SIZE 1500
 #define GMAC_RX_BUFFER_SIZE 128
@@ -338,10 +340,29 @@ u32 gmac_write_raw(const u8* buffer, u32 size) {
     return 0;
 }
 
+/*
+ * The GMAC status is handled in the system workqueue. Several interrupts
+ * before the worker runs are coalesced, since the status registers are
+ * cumulative
+ */
+static void gmac_interrupt_work(void* arg) {
+    printl("GMAC");
+}
+
+static struct work gmac_work = {
+    .func  = gmac_interrupt_work,
+    .flags = WORK_COALESCE,
+    .node  = { .obj = &gmac_work }
+};
+
 void gmac_handler(void) {
+    scheduler_isr_enter();
+
     (void)GMAC->ISR;
     (void)GMAC->TSR;
     (void)GMAC->RSR;
 
-    printl("GMAC");
+    queue_work(&system_wq, &gmac_work);
+
+    scheduler_isr_exit();
 }
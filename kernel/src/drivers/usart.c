@@ -31,3 +31,7 @@ void usart_deinit(usart_reg* reg) {
 void usart_interrupt_enable(usart_reg* reg, u32 mask) {
     reg->IER = mask;
 }
+
+void usart_interrupt_disable(usart_reg* reg, u32 mask) {
+    reg->IDR = mask;
+}
@@ -43,6 +43,12 @@ void usart_deinit(usart_reg* reg);
 
 void usart_interrupt_enable(usart_reg* reg, u32 mask);
 
+void usart_interrupt_disable(usart_reg* reg, u32 mask);
+
+static inline u32 usart_get_interrupt_status(usart_reg* reg) {
+    return reg->CSR & reg->IMR;
+}
+
 static inline void usart_write(usart_reg* reg, u8 data) {
     /* Check that the THR is empty */
     while (!(reg->CSR & (1 << 1)));
@@ -7,10 +7,12 @@
 #include "gpio.h"
 #include "cpu.h"
 #include "usb_protocol.h"
-#include "umalloc.h"
+#include "slab.h"
 #include "pmalloc.h"
 #include "memory.h"
 #include "config.h"
+#include "workqueue.h"
+#include "scheduler.h"
 #include <stddef.h>
 
 static void usbhc_send_in(struct usb_pipe* pipe);
@@ -81,10 +83,19 @@ static const char* usb_speed[] = {
 struct usbhc* usbhc_private = NULL;
 
 /*
- * All URBs are allocated using a fast bitmap allocator. These will be allocated
- * for allmost every usb transfer, so the allocater needs to be really fast.
+ * Initializes the list node of a new URB
  */
-struct umalloc_desc urb_allocator;
+static void usbhc_urb_ctor(void* obj)
+{
+    list_node_init(&((struct urb *)obj)->node);
+}
+
+/*
+ * All URBs are allocated from a slab cache. These will be allocated for
+ * allmost every usb transfer, so the allocater needs to be really fast.
+ */
+static struct slab_cache urb_cache = SLAB_CACHE_INIT("urb",
+    sizeof(struct urb), URB_SLAB_OBJECTS, URB_ALLOCATOR_BANK, usbhc_urb_ctor);
 
 /* 
  * This resets the specified pipe. After reset the datasheet says that all pipes
@@ -121,6 +132,25 @@ static void usbhc_pipe_soft_reset(struct usb_pipe* pipe)
     spinlock_release(&pipe->lock);
 }
 
+/*
+ * The root hub status messages are printed from the system workqueue so the
+ * exception handler does not wait for the serial port. The transfer state
+ * machine and the callbacks to the USB core still run in the handler
+ */
+static struct work usbhc_disconnect_work;
+static struct work usbhc_speed_work;
+static volatile enum usb_device_speed usbhc_speed;
+
+static void usbhc_print_disconnect(void* arg)
+{
+    printl("Root hub disconnected");
+}
+
+static void usbhc_print_speed(void* arg)
+{
+    printl("Device speed => %s", usb_speed[usbhc_speed]);
+}
+
 /*
  * Default callback for root hub changes passed to USB host core. The USB 
  * core should assign a callback. So this should not run.
@@ -168,15 +198,18 @@ void usbhc_init(struct usbhc* usbhc, struct usb_pipe* pipe, u32 pipe_count)
     /* This must be called in order to detect device connection or dissconnection */
     usbhw_vbus_request_enable();
 
-    /* Initialize a bitmap allocator for URBs */
-    umalloc_new(&urb_allocator, sizeof(struct urb),
-        URB_MAX_COUNT, URB_ALLOCATOR_BANK);
+    /* Fill the URB cache so the first transfers do not have to grow it */
+    slab_cache_reserve(&urb_cache, URB_MAX_COUNT);
 
     /* Link the pipes to the USB host controller */
     usbhc->pipes = pipe;
     usbhc->num_pipes = pipe_count;
     usbhc->root_hub_callback = &default_root_hub_callback;
 
+    work_init(&usbhc_disconnect_work, usbhc_print_disconnect, NULL,
+        WORK_COALESCE);
+    work_init(&usbhc_speed_work, usbhc_print_speed, NULL, WORK_COALESCE);
+
     /* Assign the private USBHC pointer */
     usbhc_private = usbhc;
 
@@ -508,7 +541,7 @@ static void usbhc_root_hub_connect(u32 isr, struct usbhc* usbhc)
 static void usbhc_root_hub_disconnect(u32 isr, struct usbhc* usbhc)
 {
     usbhw_global_disable_interrupt(USBHW_DCONN);
-    printl("Root hub disconnected");
+    queue_work(&system_wq, &usbhc_disconnect_work);
 }
 
 static void usbhc_root_hub_reset(u32 isr, struct usbhc* usbhc)
@@ -517,9 +550,8 @@ static void usbhc_root_hub_reset(u32 isr, struct usbhc* usbhc)
     usbhw_global_disable_interrupt(USBHW_RST);
 
     /* Read the device speed status */
-    enum usb_device_speed speed = usbhw_get_device_speed();
-
-    printl("Device speed => %s", usb_speed[speed]);
+    usbhc_speed = usbhw_get_device_speed();
+    queue_work(&system_wq, &usbhc_speed_work);
 
     usbhc->root_hub_callback(usbhc, RH_EVENT_RESET_SENT);
 }
@@ -639,6 +671,8 @@ static inline void usbhc_sof_exception(u32 isr, struct usbhc* usbhc)
  */
 void usb_exception(void)
 {
+    scheduler_isr_enter();
+
     u32 isr = usbhw_global_get_status();
 
     /* SOF interrupt */
@@ -657,6 +691,8 @@ void usb_exception(void)
     }  
     /* During development this will make sure that  */
     usbhw_global_clear_status(0xFFFFFFFF);
+
+    scheduler_isr_exit();
 }
 
 /*
@@ -867,13 +903,12 @@ void usbhc_set_ep_size(struct usb_pipe* pipe, u32 ep_size)
  */
 struct urb* usbhc_alloc_urb(void)
 {
-    struct urb* urb = (struct urb *)umalloc(&urb_allocator);
+    struct urb* urb = (struct urb *)slab_alloc(&urb_cache);
 
     if (urb == NULL) {
         panic("URB alloc failed");
         return NULL;
     }
-    list_node_init(&urb->node);
     return urb;
 }
 
@@ -33,11 +33,39 @@ u8 memory_compare(const void* src1, const void* src2, u32 size) {
 }
 
 /*
- * Fills a memory region with the value `fill`
+ * Fills a memory region with the value `fill`. The aligned part is filled
+ * with word stores, eight at a time, which the compiler can merge into
+ * store multiple instructions
  */
 void memory_fill(void* dest, u8 fill, u32 size) {
     u8* dest_ptr = (u8 *)dest;
 
+    while (size && ((u32)dest_ptr & 0b11)) {
+        *dest_ptr++ = fill;
+        size--;
+    }
+
+    u32 word = (u32)fill * 0x01010101u;
+    u32* word_ptr = (u32 *)dest_ptr;
+
+    while (size >= 32) {
+        word_ptr[0] = word;
+        word_ptr[1] = word;
+        word_ptr[2] = word;
+        word_ptr[3] = word;
+        word_ptr[4] = word;
+        word_ptr[5] = word;
+        word_ptr[6] = word;
+        word_ptr[7] = word;
+        word_ptr += 8;
+        size -= 32;
+    }
+    while (size >= 4) {
+        *word_ptr++ = word;
+        size -= 4;
+    }
+
+    dest_ptr = (u8 *)word_ptr;
     while (size--) {
         *dest_ptr++ = fill;
     }
@@ -19,6 +19,7 @@ extern __bootsig__ u8 boot_signature[32];
 void panic_handler(const char* file_name, u32 line_number, const char* reason) {
     
     cpsid_f();
+    print_sync();
 
     dcache_disable();
     icache_disable();
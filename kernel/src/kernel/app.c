@@ -2,34 +2,134 @@
 
 #include "app.h"
 #include "scheduler.h"
+#include "heap.h"
 #include "print.h"
 
 #include <stddef.h>
 
+/*
+ * The application class shares the CPU between threads of the same priority
+ * in proportion to their weight. Every thread accumulates virtual runtime
+ * while running, and the thread with the least virtual runtime is picked
+ * first. A higher priority level allways runs first, so the priority is
+ * placed above the virtual runtime in the runqueue key
+ */
+#define APP_VRUNTIME_BITS 61
+#define APP_VRUNTIME_MASK (((u64)1 << APP_VRUNTIME_BITS) - 1)
+
+static inline u64 app_get_key(struct thread* thread) {
+    u64 level = PRIO_RQ_LEVELS - 1 - thread->priority;
+    return (level << APP_VRUNTIME_BITS) | (thread->vruntime & APP_VRUNTIME_MASK);
+}
+
+/*
+ * Sets the weight of a new thread. It starts with the lowest virtual runtime
+ * in the runqueue, so it can neither starve nor be starved by the others
+ */
+void app_thread_init(struct thread* thread, struct thread_info* thread_info,
+    struct rq* rq) {
+
+    u32 weight = thread_info->weight;
+    if (weight == 0) {
+        weight = APP_WEIGHT_DEFAULT;
+    } else if (weight < APP_WEIGHT_MIN) {
+        weight = APP_WEIGHT_MIN;
+    } else if (weight > APP_WEIGHT_MAX) {
+        weight = APP_WEIGHT_MAX;
+    }
+    thread->weight = weight;
+    thread->vruntime = rq->app_min_vruntime;
+}
+
 static struct thread* app_pick_thread(struct rq* rq) {
-    if (rq->app_rq.first == NULL) {
+    struct heap_node* node = heap_remove_first(&rq->app_rq);
+
+    if (node == NULL) {
         return NULL;
     }
 
-    struct dlist_node* node = dlist_remove_first(&rq->app_rq);
+    if (rq->app_rq.size == 0) {
+        rq->class_ready &= ~SCHED_CLASS_BIT(APPLICATION);
+    }
+
+    struct thread* th = (struct thread *)node->obj;
 
-    return (struct thread *)node->obj;
+    /* The minimum virtual runtime only moves forward */
+    if (th->vruntime > rq->app_min_vruntime) {
+        rq->app_min_vruntime = th->vruntime;
+    }
+    return th;
 }
 
+/*
+ * A thread which has been sleeping or blocked is placed at most
+ * APP_SLEEPER_CREDIT behind the minimum virtual runtime. This gives
+ * interactive threads a head start, without letting them monopolize the
+ * CPU after a long sleep
+ */
 static void app_enqueue(struct thread* thread, struct rq* rq) {
-    dlist_insert_last(&thread->rq_node, &rq->app_rq);
+    if (rq->app_min_vruntime > APP_SLEEPER_CREDIT) {
+        u64 min = rq->app_min_vruntime - APP_SLEEPER_CREDIT;
+        if (thread->vruntime < min) {
+            thread->vruntime = min;
+        }
+    }
+
+    thread->app_node.key = app_get_key(thread);
+    heap_insert(&thread->app_node, &rq->app_rq);
+
+    rq->class_ready |= SCHED_CLASS_BIT(APPLICATION);
 }
 
 static void app_dequeue(struct thread* thread, struct rq* rq) {
-    dlist_remove(&thread->rq_node, &rq->app_rq);
+    heap_remove(&thread->app_node, &rq->app_rq);
+
+    if (rq->app_rq.size == 0) {
+        rq->class_ready &= ~SCHED_CLASS_BIT(APPLICATION);
+    }
+}
+
+static void app_block(struct thread* thread, struct rq* rq) {
+    if (thread->rq_list == &rq->blocked_q) {
+        return;
+    }
+
+    /* The thread is either sleeping or waiting in the runqueue */
+    if (heap_node_is_queued(&thread->sleep_node)) {
+        scheduler_dequeue_delay(thread);
+    } else if (heap_node_is_queued(&thread->app_node)) {
+        app_dequeue(thread, rq);
+    }
+    dlist_insert_last(&thread->rq_node, &rq->blocked_q);
+    thread->rq_list = &rq->blocked_q;
+}
+
+static void app_unblock(struct thread* thread, struct rq* rq) {
+    if (thread->rq_list != &rq->blocked_q) {
+        return;
+    }
+    dlist_remove(&thread->rq_node, thread->rq_list);
+    thread->rq_list = NULL;
+    thread->tick_to_wake = 0;
+    app_enqueue(thread, rq);
+}
+
+/*
+ * Charges the runtime of the current thread as virtual runtime
+ */
+static void app_tick(struct thread* thread, struct rq* rq, u64 runtime) {
+    thread->vruntime += (runtime * APP_WEIGHT_DEFAULT) / thread->weight;
 }
 
 /*
  * Application scheduling class
  */
 const struct scheduling_class app_class = {
-    .next        = &background_class,
+    .id          = APPLICATION,
     .pick_thread = app_pick_thread,
     .enqueue     = app_enqueue,
-    .dequeue     = app_dequeue
+    .dequeue     = app_dequeue,
+    .block       = app_block,
+    .unblock     = app_unblock,
+    .tick        = app_tick
 };
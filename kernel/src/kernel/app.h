@@ -3,5 +3,10 @@
 #ifndef APP_H
 #define APP_H
 
+#include "types.h"
+#include "scheduler.h"
 
-#endif
\ No newline at end of file
+void app_thread_init(struct thread* thread, struct thread_info* thread_info,
+    struct rq* rq);
+
+#endif
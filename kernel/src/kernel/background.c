@@ -2,34 +2,197 @@
 
 #include "background.h"
 #include "scheduler.h"
+#include "prio_rq.h"
 #include "print.h"
 
 #include <stddef.h>
 
+/*
+ * Sets up the CPU quota of a background thread. The first period starts now
+ */
+void background_thread_init(struct thread* thread,
+    struct thread_info* thread_info) {
+
+    thread->bg_quota = 0;
+    if (thread_info->runtime && thread_info->period) {
+        thread->bg_quota = (u64)thread_info->runtime * SYSTICK_RVR;
+        thread->bg_period = (u64)thread_info->period * SYSTICK_RVR;
+        thread->bg_period_start = get_kernel_tick();
+        thread->bg_budget = thread->bg_quota;
+    }
+}
+
+/*
+ * Starts a new period with a full budget if the current one has ended
+ */
+static void background_refill(struct thread* thread, u64 now) {
+    if (now >= thread->bg_period_start + thread->bg_period) {
+        u64 periods = (now - thread->bg_period_start) / thread->bg_period;
+        thread->bg_period_start += periods * thread->bg_period;
+        thread->bg_budget = thread->bg_quota;
+    }
+}
+
+static inline u64 background_get_replenish(struct thread* thread) {
+    return thread->bg_period_start + thread->bg_period;
+}
+
+static void background_update_replenish(struct rq* rq) {
+    struct dlist_node* first = rq->bg_throttled.first;
+    if (first) {
+        rq->bg_replenish_tick = 
+            background_get_replenish((struct thread *)first->obj);
+    }
+}
+
+/*
+ * Places a thread without budget in the throttled list. The list is kept
+ * in the order the threads are replenished, so only the first has to be
+ * checked on every tick
+ */
+static void background_throttle(struct thread* thread, struct rq* rq) {
+    u64 replenish = background_get_replenish(thread);
+
+    struct dlist_node* iter = rq->bg_throttled.first;
+    while (iter && 
+        (background_get_replenish((struct thread *)iter->obj) <= replenish)) {
+        iter = iter->next;
+    }
+
+    if (iter) {
+        dlist_insert_before(&thread->rq_node, iter, &rq->bg_throttled);
+    } else {
+        dlist_insert_last(&thread->rq_node, &rq->bg_throttled);
+    }
+    thread->rq_list = &rq->bg_throttled;
+    background_update_replenish(rq);
+}
+
 static struct thread* background_pick_thread(struct rq* rq) {
-    if (rq->background_rq.first == NULL) {
+    struct dlist_node* node = prio_rq_remove_first(&rq->background_rq);
+
+    if (node == NULL) {
         return NULL;
     }
-    
-    struct dlist_node* node = dlist_remove_first(&rq->background_rq);
 
-    return (struct thread *)node->obj;
+    if (prio_rq_is_empty(&rq->background_rq)) {
+        rq->class_ready &= ~SCHED_CLASS_BIT(BACKGROUND);
+    }
+
+    struct thread* th = (struct thread *)node->obj;
+    th->rq_list = NULL;
+
+    return th;
 }
 
 static void background_enqueue(struct thread* thread, struct rq* rq) {
-    dlist_insert_last(&thread->rq_node, &rq->background_rq);
+    /* A thread which has used up its quota waits for the next period */
+    if (thread->bg_quota) {
+        background_refill(thread, get_kernel_tick());
+        if (thread->bg_budget == 0) {
+            background_throttle(thread, rq);
+            return;
+        }
+    }
+
+    thread->rq_list = prio_rq_insert(&thread->rq_node, thread->priority,
+        &rq->background_rq);
+
+    rq->class_ready |= SCHED_CLASS_BIT(BACKGROUND);
 }
 
 static void background_dequeue(struct thread* thread, struct rq* rq) {
-    dlist_remove(&thread->rq_node, &rq->background_rq);
+    if (thread->rq_list == &rq->bg_throttled) {
+        dlist_remove(&thread->rq_node, &rq->bg_throttled);
+        thread->rq_list = NULL;
+        background_update_replenish(rq);
+        return;
+    }
+
+    prio_rq_remove(&thread->rq_node, thread->rq_list, &rq->background_rq);
+    thread->rq_list = NULL;
+
+    if (prio_rq_is_empty(&rq->background_rq)) {
+        rq->class_ready &= ~SCHED_CLASS_BIT(BACKGROUND);
+    }
+}
+
+static void background_block(struct thread* thread, struct rq* rq) {
+    if (thread->rq_list == &rq->blocked_q) {
+        return;
+    }
+
+    /* The thread is either sleeping, throttled or waiting in the runqueue */
+    if (heap_node_is_queued(&thread->sleep_node)) {
+        scheduler_dequeue_delay(thread);
+    } else if (thread->rq_list) {
+        background_dequeue(thread, rq);
+    }
+    dlist_insert_last(&thread->rq_node, &rq->blocked_q);
+    thread->rq_list = &rq->blocked_q;
+}
+
+static void background_unblock(struct thread* thread, struct rq* rq) {
+    if (thread->rq_list != &rq->blocked_q) {
+        return;
+    }
+    dlist_remove(&thread->rq_node, thread->rq_list);
+    thread->tick_to_wake = 0;
+    background_enqueue(thread, rq);
+}
+
+/*
+ * Charges the runtime of the current thread to its budget. When the budget
+ * is used up the thread is throttled until the next period
+ */
+static void background_tick(struct thread* thread, struct rq* rq,
+    u64 runtime) {
+
+    if (thread->bg_quota == 0) {
+        return;
+    }
+    background_refill(thread, get_kernel_tick());
+
+    if (runtime < thread->bg_budget) {
+        thread->bg_budget -= runtime;
+        return;
+    }
+    thread->bg_budget = 0;
+
+    /* A thread going to sleep or being blocked is not throttled */
+    if (heap_node_is_queued(&thread->sleep_node) || 
+        (thread->rq_list == &rq->blocked_q)) {
+        return;
+    }
+    background_throttle(thread, rq);
+}
+
+/*
+ * Moves the throttled threads whose period has ended back into the
+ * runqueue. This is called from the SysTick exception
+ */
+void background_replenish(struct rq* rq) {
+    u64 now = get_kernel_tick();
+
+    while (rq->bg_throttled.first && (rq->bg_replenish_tick <= now)) {
+        struct dlist_node* node = dlist_remove_first(&rq->bg_throttled);
+        struct thread* thread = (struct thread *)node->obj;
+        thread->rq_list = NULL;
+
+        background_update_replenish(rq);
+        background_enqueue(thread, rq);
+    }
 }
 
 /* 
  * Background scheduling class
  */
 const struct scheduling_class background_class = {
-    .next        = &idle_class,
+    .id          = BACKGROUND,
     .pick_thread = background_pick_thread,
     .enqueue     = background_enqueue,
-    .dequeue     = background_dequeue
+    .dequeue     = background_dequeue,
+    .block       = background_block,
+    .unblock     = background_unblock,
+    .tick        = background_tick
 };
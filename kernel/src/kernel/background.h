@@ -4,5 +4,11 @@
 #define BACKGROUND_H
 
 #include "types.h"
+#include "scheduler.h"
 
-#endif
\ No newline at end of file
+void background_thread_init(struct thread* thread,
+    struct thread_info* thread_info);
+
+void background_replenish(struct rq* rq);
+
+#endif
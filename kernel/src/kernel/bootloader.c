@@ -12,6 +12,7 @@
 #include "hardware.h"
 #include "clock.h"
 #include "cache.h"
+#include "msg_queue.h"
 
 #define START_BYTE 0xAA
 #define END_BYTE   0x55
@@ -32,6 +33,13 @@ volatile struct frame frame = {0};
 volatile u32 frame_index = 0;
 volatile u8 frame_received = 0;
 
+/*
+ * A received frame is passed to the thread waiting in `wait_new_frame`. Only
+ * one frame is outstanding until `send_response` is called
+ */
+static struct msg_queue frame_queue;
+static void* frame_ring[1];
+
 struct image_info {
     /* Version numer of the kernel */
     u32 major_version;
@@ -105,6 +113,7 @@ void bootloader_init(void) {
     nvic_enable(23);
 
     bus_state = STATE_IDLE;
+    msg_queue_init(&frame_queue, frame_ring, 1);
 
     /* Grab the bootlaoder info section */
     const struct image_info* info = 
@@ -127,6 +136,13 @@ void send_response(u8 error_code) {
     serial_print("%c", (char)error_code);
 }
 
+/*
+ * Blocks the calling thread until a new frame has been received
+ */
+struct frame* wait_new_frame(void) {
+    return (struct frame *)msg_receive(&frame_queue, MSG_WAIT_FOREVER);
+}
+
 /* Check if a new frame has been received */
 u8 check_new_frame(void) {
     
@@ -208,6 +224,7 @@ void usart0_exception(void) {
 
                 if (fcs == frame.fcs) {
                     frame_received = 1;
+                    msg_send_isr(&frame_queue, (void *)&frame);
                 } else {
                     send_response(RESP_ERROR | RESP_FCS_ERROR);
                 }
@@ -33,4 +33,6 @@ void send_response(u8 error_code);
 
 u8 check_new_frame(void);
 
+struct frame* wait_new_frame(void);
+
 #endif
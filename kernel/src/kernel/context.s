@@ -12,6 +12,8 @@
  */
 .extern curr_thread;
 .extern next_thread;
+.extern scheduler_switch_begin;
+.extern scheduler_switch_end;
 
 .global test_kill
 
@@ -25,11 +27,18 @@
  * registers. This is known as a stack frame. When the FPU is disabled the
  * exeption triggers the stacking of R0-R3, R12, LR, PC and xPSR. The exeption
  * handler stack the remainding register R4-R11 and switchs the stack pointer.
+ * When a thread has used the FPU the CPU also stacks S0-S15 and FPSCR, and
+ * the handler stacks S16-S31 below the general purpose registers.
  */
 .section .text
 .global pendsv_exception
 .type pendsv_exception, %function 
 pendsv_exception:
+	/* Charge the current thread for its CPU time */
+	push {r0, lr}
+	bl scheduler_switch_begin
+	pop {r0, lr}
+
 	/*
 	 * The treads uses the PSP. This has to be manually retrieve
 	 * since the execption is using the MSP.
@@ -42,20 +51,19 @@ pendsv_exception:
 	ldr r2, [r1]
 	mov r3, #0
 	cmp r3, r2
-	beq _new_thread
+	beq _exit_thread
 
 	/*
-	 * Bit 4 in the EXC_RETURN indicates that the stack contains
-	 * extra space for the floating point registers. These might 
-	 * be stacked or the lazer state preservation might be active.
-	 * This can be read from the FPCCR.LSPACT bit. The next context
-	 * holds it FPU status in the EXC_RETURN in the LR therefore
-	 * this register is stacked twice.
+	 * Bit 4 in the EXC_RETURN is cleared when the stack frame contains
+	 * extra space for the floating point registers. S0-S15 and FPSCR
+	 * might be stacked or the lazy state preservation might be active,
+	 * which is shown by the FPCCR.LSPACT bit. In that case the VSTMDB
+	 * instruction triggers the pending stacking before S16-S31 are
+	 * stored. Threads which have never used the FPU skip this.
 	 */
-
-	//tst lr, #0x10
-	//it eq
-	//vstmdbeq r0!, {s16-s31}
+	tst lr, #0x10
+	it eq
+	vstmdbeq r0!, {s16-s31}
 
 	/* Store the general purpose register not stacked by the CPU */
 	stmdb r0!, {r4-r11}
@@ -63,28 +71,56 @@ pendsv_exception:
 	/* Update the stack pointer of  the current running thread */
 	str r0, [r2]
 
+	/* Store the EXC_RETURN in `exc_return` which holds the FPU status */
+	str lr, [r2, #8]
+
+	b _new_thread
+
+_exit_thread:
+	/*
+	 * The thread has exited and its stack is freed. A pending lazy
+	 * stacking still points FPCAR into that stack, and the next floating
+	 * point instruction would write S0-S15 and FPSCR into freed memory.
+	 * The state is not needed, so the stacking is cancelled by clearing
+	 * FPCCR.LSPACT.
+	 */
+	tst lr, #0x10
+	bne _new_thread
+	ldr r3, =0xE000EF34
+	ldr r0, [r3]
+	bic r0, r0, #1
+	str r0, [r3]
+	dsb
+	isb
+
 _new_thread:
 	/* Make `curr_thread` point to the `next_thread` */
 	ldr r0, =next_thread
 	ldr r2, [r0]
 	str r2, [r1]
 
-	/* Get the stack pointer from the next thread to run */
+	/* Get the stack pointer and the EXC_RETURN from the next thread */
 	ldr r1, [r2]
+	ldr lr, [r2, #8]
 
 	/* Restore the general purpose registers not unstacked by the CPU */
 	ldmia r1!, {r4-r11}
 
 	/* Check if the new context uses floating point context */
-	//tst lr, #0x10
-	//it eq
-	//vldmiaeq r0!, {s16-s31}
+	tst lr, #0x10
+	it eq
+	vldmiaeq r1!, {s16-s31}
 
 	/* Load the stack pointer into PSP */
 	msr psp, r1
 	isb
-    
-    bx lr
+
+	/* Start the CPU time accounting of the new thread */
+	push {r0, lr}
+	bl scheduler_switch_end
+	pop {r0, lr}
+
+	bx lr
 
 /*
  * This function will setup the core registers for the first thread to run
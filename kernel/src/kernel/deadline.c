@@ -0,0 +1,214 @@
+/* Copyright (C) StrawberryHacker */
+
+#include "deadline.h"
+#include "scheduler.h"
+#include "dlist.h"
+#include "heap.h"
+
+#include <stddef.h>
+
+/*
+ * Defined in scheduler.c
+ */
+extern struct thread* curr_thread;
+
+/*
+ * Earliest deadline first scheduling class. Every thread owns a budget of
+ * `dl_runtime` ticks per `dl_period`. Ready threads are kept in a heap
+ * ordered by their absolute deadline, so the thread with the earliest
+ * deadline is allways picked first. A thread which uses up its budget is
+ * throttled in the sleep queue until its next period starts. Together with
+ * the admission control in `new_thread` this guarantees all deadlines as
+ * long as the total density is below 100 %
+ */
+
+/*
+ * Returns the density of a deadline thread in per mille rounded up. A
+ * deadline shorter than the period needs more than runtime over period of
+ * the CPU, so the utilization alone can not guarantee it
+ */
+static u32 deadline_get_util(struct thread_info* thread_info) {
+    u32 window = thread_info->period;
+    if (thread_info->deadline && (thread_info->deadline < window)) {
+        window = thread_info->deadline;
+    }
+    return (thread_info->runtime * 1000 + window - 1) / window;
+}
+
+/*
+ * Checks if a new deadline thread can be admitted without exceeding the
+ * utilization bound. If so the utilization is reserved and 1 is returned
+ */
+u8 deadline_admit(struct thread_info* thread_info, struct rq* rq) {
+    if ((thread_info->period == 0) || (thread_info->runtime == 0)) {
+        return 0;
+    }
+
+    u32 deadline = thread_info->deadline;
+    if (deadline == 0) {
+        deadline = thread_info->period;
+    }
+
+    /* The runtime must fit inside both the deadline and the period */
+    if ((thread_info->runtime > deadline) || 
+        (deadline > thread_info->period)) {
+        return 0;
+    }
+
+    if (rq->dl_count >= rq->dl_rq.capacity) {
+        return 0;
+    }
+
+    u32 util = deadline_get_util(thread_info);
+    if (rq->dl_util + util > DEADLINE_UTIL_MAX) {
+        return 0;
+    }
+
+    rq->dl_util += util;
+    rq->dl_count++;
+    return 1;
+}
+
+/*
+ * Releases the utilization reserved by a deadline thread
+ */
+void deadline_release(struct thread* thread, struct rq* rq) {
+    rq->dl_util -= thread->dl_util;
+    rq->dl_count--;
+}
+
+/*
+ * Sets up the deadline parameters of an admitted thread. The first period
+ * starts now
+ */
+void deadline_thread_init(struct thread* thread,
+    struct thread_info* thread_info) {
+
+    u32 deadline = thread_info->deadline;
+    if (deadline == 0) {
+        deadline = thread_info->period;
+    }
+
+    thread->dl_runtime = (u64)thread_info->runtime * SYSTICK_RVR;
+    thread->dl_period = (u64)thread_info->period * SYSTICK_RVR;
+    thread->dl_deadline = (u64)deadline * SYSTICK_RVR;
+    thread->dl_period_start = get_kernel_tick();
+    thread->dl_budget = thread->dl_runtime;
+    thread->dl_util = deadline_get_util(thread_info);
+}
+
+static struct thread* deadline_pick_thread(struct rq* rq) {
+    struct heap_node* node = heap_remove_first(&rq->dl_rq);
+
+    if (node == NULL) {
+        return NULL;
+    }
+
+    if (rq->dl_rq.size == 0) {
+        rq->class_ready &= ~SCHED_CLASS_BIT(DEADLINE);
+    }
+    return (struct thread *)node->obj;
+}
+
+/*
+ * Constant bandwidth server wakeup rule. A waking thread keeps its deadline
+ * and budget only if the budget can be used up before the deadline without
+ * exceeding the reserved density. Otherwise the thread could use an old
+ * deadline to take more than its reservation, so a new period starts now
+ * with a full budget
+ */
+static void deadline_wakeup(struct thread* thread, u64 now) {
+    u64 deadline = thread->dl_period_start + thread->dl_deadline;
+
+    if ((now >= deadline) || (thread->dl_budget * thread->dl_deadline >
+        thread->dl_runtime * (deadline - now))) {
+        thread->dl_period_start = now;
+        thread->dl_budget = thread->dl_runtime;
+    }
+}
+
+static void deadline_enqueue(struct thread* thread, struct rq* rq) {
+    u64 now = get_kernel_tick();
+
+    /* A preempted thread is enqueued again while it is still current */
+    if (thread != curr_thread) {
+        deadline_wakeup(thread, now);
+    }
+
+    /* Start a new period with a full budget if the current one has ended */
+    if (now >= thread->dl_period_start + thread->dl_period) {
+        u64 periods = (now - thread->dl_period_start) / thread->dl_period;
+        thread->dl_period_start += periods * thread->dl_period;
+        thread->dl_budget = thread->dl_runtime;
+    }
+
+    thread->dl_node.key = thread->dl_period_start + thread->dl_deadline;
+    heap_insert(&thread->dl_node, &rq->dl_rq);
+
+    rq->class_ready |= SCHED_CLASS_BIT(DEADLINE);
+}
+
+static void deadline_dequeue(struct thread* thread, struct rq* rq) {
+    heap_remove(&thread->dl_node, &rq->dl_rq);
+
+    if (rq->dl_rq.size == 0) {
+        rq->class_ready &= ~SCHED_CLASS_BIT(DEADLINE);
+    }
+}
+
+static void deadline_block(struct thread* thread, struct rq* rq) {
+    if (thread->rq_list == &rq->blocked_q) {
+        return;
+    }
+
+    /* The thread is either sleeping, throttled or waiting in the runqueue */
+    if (heap_node_is_queued(&thread->sleep_node)) {
+        scheduler_dequeue_delay(thread);
+    } else if (heap_node_is_queued(&thread->dl_node)) {
+        deadline_dequeue(thread, rq);
+    }
+    dlist_insert_last(&thread->rq_node, &rq->blocked_q);
+    thread->rq_list = &rq->blocked_q;
+}
+
+static void deadline_unblock(struct thread* thread, struct rq* rq) {
+    if (thread->rq_list != &rq->blocked_q) {
+        return;
+    }
+    dlist_remove(&thread->rq_node, thread->rq_list);
+    thread->rq_list = NULL;
+    thread->tick_to_wake = 0;
+    deadline_enqueue(thread, rq);
+}
+
+/*
+ * Charges the runtime of the current thread to its budget. When the budget
+ * is used up the thread is throttled until the next period
+ */
+static void deadline_tick(struct thread* thread, struct rq* rq, u64 runtime) {
+    if (runtime < thread->dl_budget) {
+        thread->dl_budget -= runtime;
+        return;
+    }
+    thread->dl_budget = 0;
+
+    /* A thread going to sleep or being blocked is not throttled */
+    if (heap_node_is_queued(&thread->sleep_node) || 
+        (thread->rq_list == &rq->blocked_q)) {
+        return;
+    }
+
+    thread->tick_to_wake = thread->dl_period_start + thread->dl_period;
+    scheduler_enqueue_delay(thread);
+}
+
+/* Deadline scheduling class */
+const struct scheduling_class deadline_class = {
+    .id          = DEADLINE,
+    .pick_thread = deadline_pick_thread,
+    .enqueue     = deadline_enqueue,
+    .dequeue     = deadline_dequeue,
+    .block       = deadline_block,
+    .unblock     = deadline_unblock,
+    .tick        = deadline_tick
+};
@@ -0,0 +1,16 @@
+/* Copyright (C) StrawberryHacker */
+
+#ifndef DEADLINE_H
+#define DEADLINE_H
+
+#include "types.h"
+#include "scheduler.h"
+
+u8 deadline_admit(struct thread_info* thread_info, struct rq* rq);
+
+void deadline_release(struct thread* thread, struct rq* rq);
+
+void deadline_thread_init(struct thread* thread,
+    struct thread_info* thread_info);
+
+#endif
@@ -128,35 +128,33 @@ void dlist_insert_before(struct dlist_node* i_node, struct dlist_node* b_node,
 }
 
 /*
- * Removes the first node from a `dlist`
+ * Removes the first node from a `dlist`. Returns NULL if the list is empty
  */
 struct dlist_node* dlist_remove_first(struct dlist* list) {
     /* First node */
-    struct dlist_node* first = NULL;
-    if (list->first) {
-        first = list->first;
+    struct dlist_node* first = list->first;
+    if (first == NULL) {
+        return NULL;
+    }
 
-        /* Check if the list contains more than one node */
-        if (first->next) {
+    /* Check if the list contains more than one node */
+    if (first->next) {
 
-            /* Remove the backward link from the second node */
-            first->next->prev = NULL;
-            list->first = first->next;
-        } else {
+        /* Remove the backward link from the second node */
+        first->next->prev = NULL;
+        list->first = first->next;
+    } else {
 
-            /* Only one node present */
-            list->first = NULL;
-            list->last = NULL;
-        }
+        /* Only one node present */
+        list->first = NULL;
+        list->last = NULL;
+    }
 
-        /* Decrement the size */
-        if (list->size == 0) {
-            panic("List size is zero");
-        }
-        list->size--;
-    } else {
-        panic("List does not contain any elements");
+    /* Decrement the size */
+    if (list->size == 0) {
+        panic("List size is zero");
     }
+    list->size--;
 
     /* Disable the links */
     first->next = NULL;
@@ -39,6 +39,11 @@ tid_t dynamic_linker_run(u32* binary) {
     thread_info.stack_size = app_info->stack;
     thread_info.arg = NULL;
     thread_info.class = app_info->scheduler;
+    thread_info.priority = 0;
+    thread_info.runtime = 0;
+    thread_info.period = 0;
+    thread_info.deadline = 0;
+    thread_info.weight = 0;
     thread_info.code_addr = binary;
 
     /*
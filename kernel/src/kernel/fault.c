@@ -110,18 +110,21 @@ void print_hard_fault(void) {
 
 void mem_fault(void) {
     cpsid_f();
+    print_sync();
     printl("Memory\n");
     panic("Memory fault");
 }
 
 void bus_fault(void) {
     cpsid_f();
+    print_sync();
     printl("Bus\n");
     panic("Bus fault");
 }
 
 void usage_fault(void) {
     cpsid_f();
+    print_sync();
     printl("Usage\n");
     panic("Usage fault");
 }
@@ -136,6 +139,7 @@ void usage_fault(void) {
  */
 void hard_fault(u32* stack_pointer) {
     cpsid_f();
+    print_sync();
 
     print(ANSI_RED "Hard fault occured:\n");
     print_hard_fault();
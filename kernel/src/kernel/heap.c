@@ -0,0 +1,137 @@
+/* Copyright (C) StrawberryHacker */
+
+#include "heap.h"
+#include "panic.h"
+
+#include <stddef.h>
+
+/*
+ * Places `node` at `index` in the heap array and updates its index
+ */
+static inline void heap_set(struct heap* heap, u32 index,
+    struct heap_node* node) {
+
+    heap->nodes[index] = node;
+    node->index = index;
+}
+
+/*
+ * Moves the node at `index` towards the root until the parent key is lower
+ * than or equal to the node key
+ */
+static void heap_sift_up(struct heap* heap, u32 index) {
+    struct heap_node* node = heap->nodes[index];
+
+    while (index) {
+        u32 parent = (index - 1) / 2;
+
+        if (heap->nodes[parent]->key <= node->key) {
+            break;
+        }
+        heap_set(heap, index, heap->nodes[parent]);
+        index = parent;
+    }
+    heap_set(heap, index, node);
+}
+
+/*
+ * Moves the node at `index` away from the root until both children have a
+ * key higher than or equal to the node key
+ */
+static void heap_sift_down(struct heap* heap, u32 index) {
+    struct heap_node* node = heap->nodes[index];
+
+    while (1) {
+        u32 child = 2 * index + 1;
+
+        if (child >= heap->size) {
+            break;
+        }
+
+        /* Pick the child with the lowest key */
+        if ((child + 1 < heap->size) &&
+            (heap->nodes[child + 1]->key < heap->nodes[child]->key)) {
+            child++;
+        }
+
+        if (node->key <= heap->nodes[child]->key) {
+            break;
+        }
+        heap_set(heap, index, heap->nodes[child]);
+        index = child;
+    }
+    heap_set(heap, index, node);
+}
+
+/*
+ * Initializes a heap using `nodes` as storage for `capacity` node pointers
+ */
+void heap_init(struct heap* heap, struct heap_node** nodes, u32 capacity) {
+    heap->nodes = nodes;
+    heap->size = 0;
+    heap->capacity = capacity;
+}
+
+void heap_node_init(struct heap_node* node) {
+    node->key = 0;
+    node->index = HEAP_INDEX_NONE;
+    node->obj = NULL;
+}
+
+/*
+ * Inserts a `node` into the heap. The `key` must be set before calling this
+ */
+void heap_insert(struct heap_node* node, struct heap* heap) {
+    /* Check if the heap contains the `node` */
+    if (node->index != HEAP_INDEX_NONE) {
+        panic("Heap error");
+    }
+
+    if (heap->size >= heap->capacity) {
+        panic("Heap full");
+    }
+
+    heap_set(heap, heap->size, node);
+    heap->size++;
+    heap_sift_up(heap, node->index);
+}
+
+/*
+ * Removes any node from the heap
+ */
+void heap_remove(struct heap_node* node, struct heap* heap) {
+    u32 index = node->index;
+
+    if ((index >= heap->size) || (heap->nodes[index] != node)) {
+        panic("Heap error");
+    }
+
+    /* Move the last node into the hole and restore the heap order */
+    heap->size--;
+    if (index != heap->size) {
+        struct heap_node* last = heap->nodes[heap->size];
+        heap_set(heap, index, last);
+
+        if (index && (last->key < heap->nodes[(index - 1) / 2]->key)) {
+            heap_sift_up(heap, index);
+        } else {
+            heap_sift_down(heap, index);
+        }
+    }
+    node->index = HEAP_INDEX_NONE;
+}
+
+/*
+ * Removes and returns the node with the lowest key. Returns NULL if the
+ * heap is empty
+ */
+struct heap_node* heap_remove_first(struct heap* heap) {
+    if (heap->size == 0) {
+        return NULL;
+    }
+
+    struct heap_node* first = heap->nodes[0];
+    heap_remove(first, heap);
+
+    return first;
+}
@@ -0,0 +1,57 @@
+/* Copyright (C) StrawberryHacker */
+
+#ifndef HEAP_H
+#define HEAP_H
+
+#include "types.h"
+
+/* Index of a node which is not present in any heap */
+#define HEAP_INDEX_NONE 0xFFFFFFFF
+
+/*
+ * Generic intrusive binary min-heap interface
+ * The heap stores pointers to `heap_node` structures in an array given by 
+ * the user. Each node remembers its own array index, so any node can be
+ * removed in O(log n) without searching. The node with the lowest `key` is
+ * allways at index zero. Like the `dlist`, the `obj` can be used for linking
+ * the node to an object. Normally this will be a thread control block
+ */
+struct heap_node {
+    u64 key;
+    u32 index;
+
+    void* obj;
+};
+
+struct heap {
+    struct heap_node** nodes;
+
+    u32 size;
+    u32 capacity;
+};
+
+void heap_init(struct heap* heap, struct heap_node** nodes, u32 capacity);
+
+void heap_node_init(struct heap_node* node);
+
+void heap_insert(struct heap_node* node, struct heap* heap);
+
+void heap_remove(struct heap_node* node, struct heap* heap);
+
+struct heap_node* heap_remove_first(struct heap* heap);
+
+/*
+ * Returns the node with the lowest key without removing it
+ */
+static inline struct heap_node* heap_get_first(struct heap* heap) {
+    return (heap->size) ? heap->nodes[0] : 0;
+}
+
+/*
+ * Returns 1 if the node is present in a heap
+ */
+static inline u8 heap_node_is_queued(struct heap_node* node) {
+    return (node->index != HEAP_INDEX_NONE) ? 1 : 0;
+}
+
+#endif
@@ -15,6 +15,9 @@ static struct thread* idle_pick_thread(struct rq* rq) {
 
 static void idle_enqueue(struct thread* thread, struct rq* rq) {
     rq->idle = thread;
+
+    /* The idle class is never removed from the ready bitmap */
+    rq->class_ready |= SCHED_CLASS_BIT(IDLE);
 }
 
 static void idle_dequeue(struct thread* thread, struct rq* rq) {
@@ -23,7 +26,7 @@ static void idle_dequeue(struct thread* thread, struct rq* rq) {
 
 /* Idle scheduling class */
 const struct scheduling_class idle_class = {
-    .next        = NULL,
+    .id          = IDLE,
     .pick_thread = idle_pick_thread,
     .enqueue     = idle_enqueue,
     .dequeue     = idle_dequeue
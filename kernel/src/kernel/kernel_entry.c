@@ -23,6 +23,9 @@
 #include "usb_hid.h"
 #include "led.h"
 #include "button.h"
+#include "workqueue.h"
+#include "timer.h"
+#include "dwt.h"
 
 void kernel_entry(void) {
     /* Disable the watchdog timer */
@@ -36,7 +39,9 @@ void kernel_entry(void) {
 	cpsie_f();
 	cpsid_i();
 
-	//fpu_enable();
+	/* Floating point context is saved lazily by the context switch */
+	fpu_enable();
+	fpu_lazy_stacking_enable();
 
 	/*
 	 * The CPU will run at 300 Mhz so the flash access cycles has to be
@@ -67,8 +72,21 @@ void kernel_entry(void) {
 	led_init();
 	button_init();	
 
-	/* Initialize the dynamic memory core */
+	/*
+	 * Initialize the dynamic memory core. This is timed with the cycle
+	 * counter since the benchmark timer interrupt is masked here
+	 */
+	dwt_enable();
+	u32 mm_cycles = dwt_get_cycles();
 	mm_init();
+	mm_cycles = dwt_get_cycles() - mm_cycles;
+	printl("Memory init: %d us", mm_cycles / 300);
+
+	/* Worker thread for work deferred from exception handlers */
+	workqueue_init(&system_wq, "Workqueue", SYSTEM_WQ_PRIORITY);
+
+	/* Thread running the software timer callbacks */
+	timer_service_init();
 
 	/* Setup true random and psudo random */
 	trand_init();
@@ -0,0 +1,75 @@
+/* Copyright (C) StrawberryHacker */
+
+#ifndef MPSC_H
+#define MPSC_H
+
+#include "types.h"
+#include "exclusive.h"
+
+#include <stddef.h>
+
+/*
+ * Lock-free intrusive multiple producer single consumer list
+ * Any number of threads and exception handlers might push nodes, while a
+ * single consumer takes the whole list at once. Both operations use LDREX
+ * and STREX, so a push is safe from any interrupt priority without masking
+ * interrupts. Like the `dlist`, the `obj` can be used for linking the node
+ * to an object
+ */
+struct mpsc_node {
+    struct mpsc_node* next;
+
+    void* obj;
+};
+
+struct mpsc {
+    struct mpsc_node* volatile head;
+};
+
+static inline void mpsc_init(struct mpsc* mpsc) {
+    mpsc->head = NULL;
+}
+
+static inline u8 mpsc_is_empty(struct mpsc* mpsc) {
+    return (mpsc->head == NULL) ? 1 : 0;
+}
+
+/*
+ * Pushes a node onto the list. Returns 1 if the list was empty. The node
+ * must not be present in the list allready
+ */
+static inline u8 mpsc_push(struct mpsc_node* node, struct mpsc* mpsc) {
+    struct mpsc_node* first;
+
+    do {
+        first = ldrex_ptr((void* volatile *)&mpsc->head);
+        node->next = first;
+    } while (strex_ptr((void* volatile *)&mpsc->head, node));
+
+    return (first == NULL) ? 1 : 0;
+}
+
+/*
+ * Takes all nodes from the list and returns them in the order they were
+ * pushed. The `next` field of a node has to be read before the node can be
+ * pushed again
+ */
+static inline struct mpsc_node* mpsc_take_all(struct mpsc* mpsc) {
+    struct mpsc_node* list;
+
+    do {
+        list = ldrex_ptr((void* volatile *)&mpsc->head);
+    } while (strex_ptr((void* volatile *)&mpsc->head, NULL));
+
+    /* The list is in LIFO order */
+    struct mpsc_node* fifo = NULL;
+    while (list) {
+        struct mpsc_node* next = list->next;
+        list->next = fifo;
+        fifo = list;
+        list = next;
+    }
+    return fifo;
+}
+
+#endif
@@ -0,0 +1,288 @@
+/* Copyright (C) StrawberryHacker */
+
+#include "msg_queue.h"
+#include "scheduler.h"
+#include "mm.h"
+#include "cpu.h"
+#include "panic.h"
+#include "config.h"
+
+#include <stddef.h>
+
+/*
+ * Defined in scheduler.c
+ */
+extern struct thread* curr_thread;
+
+/*
+ * A waiting thread places this on its own stack. `woken` is set by the
+ * thread which removes the waiter from the wait list, so the waiter can
+ * tell a wakeup from a timeout
+ */
+struct msg_waiter {
+    struct thread* thread;
+    volatile u8 woken;
+
+    struct dlist_node node;
+};
+
+/*
+ * Returns 1 if `thread` should run before the current thread
+ */
+static u8 msg_preempts(struct thread* thread) {
+    u32 rank = SCHED_CLASS_RANK(thread->class->id);
+    u32 curr_rank = SCHED_CLASS_RANK(curr_thread->class->id);
+    if (rank != curr_rank) {
+        return (rank < curr_rank) ? 1 : 0;
+    }
+    return (thread->priority > curr_thread->priority) ? 1 : 0;
+}
+
+/*
+ * Blocks the current thread on a wait list until it is woken or the kernel
+ * tick reaches `end`. Must be called with interrupts disabled and returns
+ * with interrupts disabled. Returns 0 if the wait timed out
+ */
+static u8 msg_wait(struct dlist* wait_q, u64 end, u32 timeout) {
+    u64 now = get_kernel_tick();
+    if ((timeout != MSG_WAIT_FOREVER) && (end <= now)) {
+        return 0;
+    }
+
+    struct msg_waiter waiter;
+    waiter.thread = curr_thread;
+    waiter.woken = 0;
+    dlist_node_init(&waiter.node);
+    waiter.node.obj = &waiter;
+    dlist_insert_last(&waiter.node, wait_q);
+    curr_thread->wait_list = wait_q;
+    curr_thread->wait_entry = &waiter.node;
+
+    if (timeout == MSG_WAIT_FOREVER) {
+        scheduler_block_thread(curr_thread);
+    } else {
+        scheduler_block_thread_timeout(curr_thread, end - now);
+    }
+
+    /* The context switch happens here */
+    cpsie_i();
+    cpsid_i();
+
+    /*
+     * A waiter which is not woken has timed out, or has been unblocked by
+     * someone else. In the last case a thread waiting forever just retries
+     */
+    if (!waiter.woken) {
+        dlist_remove(&waiter.node, wait_q);
+        curr_thread->wait_list = NULL;
+        return (timeout == MSG_WAIT_FOREVER) ? 1 : 0;
+    }
+    return 1;
+}
+
+/*
+ * Wakes the first thread in a wait list. Returns the thread or NULL if the
+ * list is empty. Must be called with interrupts disabled
+ */
+static struct thread* msg_wake_first(struct dlist* wait_q, u8 from_isr) {
+    struct dlist_node* node = dlist_remove_first(wait_q);
+    if (node == NULL) {
+        return NULL;
+    }
+
+    struct msg_waiter* waiter = (struct msg_waiter *)node->obj;
+    waiter->woken = 1;
+    waiter->thread->wait_list = NULL;
+
+    if (from_isr) {
+        scheduler_unblock_thread_isr(waiter->thread);
+    } else {
+        scheduler_unblock_thread(waiter->thread);
+    }
+    return waiter->thread;
+}
+
+/*
+ * Initializes a message queue using the given storage for `capacity`
+ * message pointers. The queue has no message pool
+ */
+void msg_queue_init(struct msg_queue* queue, void** ring, u32 capacity) {
+    queue->ring = ring;
+    queue->capacity = capacity;
+    queue->head = 0;
+    queue->count = 0;
+
+    dlist_init(&queue->send_q);
+    dlist_init(&queue->recv_q);
+
+    queue->msg_size = 0;
+    queue->msg_count = 0;
+}
+
+/*
+ * Allocates a message queue of `capacity` entries with a pool of
+ * `msg_count` message buffers of `msg_size` bytes. Returns 0 if the queue
+ * is too large or there is not enough memory
+ */
+u8 msg_queue_new(struct msg_queue* queue, u32 capacity, u32 msg_size,
+    u32 msg_count)
+{
+    if ((capacity == 0) || (capacity > MSG_QUEUE_MAX_CAPACITY)) {
+        return 0;
+    }
+    void** ring = (void **)mm_alloc(capacity * sizeof(void *), SRAM);
+    if (ring == NULL) {
+        return 0;
+    }
+    msg_queue_init(queue, ring, capacity);
+
+    if (msg_count) {
+        if (!umalloc_try_new(&queue->pool, msg_size, msg_count,
+            MSG_POOL_BANK)) {
+
+            mm_free(ring);
+            return 0;
+        }
+        queue->msg_size = msg_size;
+        queue->msg_count = msg_count;
+    }
+    return 1;
+}
+
+/*
+ * Deletes a message queue made by `msg_queue_new`. No thread must be
+ * waiting on the queue, and all messages are lost
+ */
+void msg_queue_delete(struct msg_queue* queue) {
+    if (queue->send_q.size || queue->recv_q.size) {
+        panic("Message queue in use");
+    }
+    if (queue->msg_count) {
+        umalloc_delete(&queue->pool);
+    }
+    mm_free(queue->ring);
+}
+
+/*
+ * Allocates a message buffer from the pool of the queue. Returns NULL if
+ * all buffers are in use. This can be called from exception handlers
+ */
+void* msg_alloc(struct msg_queue* queue) {
+    if (queue->msg_count == 0) {
+        panic("Message queue has no pool");
+    }
+
+    void* msg = NULL;
+
+    u32 primask = cpu_get_primask();
+    cpsid_i();
+    if (umalloc_get_used(&queue->pool) < queue->msg_count) {
+        msg = umalloc(&queue->pool);
+    }
+    cpu_set_primask(primask);
+
+    return msg;
+}
+
+/*
+ * Gives a message buffer back to the pool of the queue. This can be called
+ * from exception handlers
+ */
+void msg_free(struct msg_queue* queue, void* msg) {
+    u32 primask = cpu_get_primask();
+    cpsid_i();
+    ufree(&queue->pool, msg);
+    cpu_set_primask(primask);
+}
+
+/*
+ * Places a message in the queue and wakes the first waiting receiver. Must
+ * be called with interrupts disabled and room in the queue
+ */
+static struct thread* msg_put(struct msg_queue* queue, void* msg,
+    u8 from_isr)
+{
+    u32 tail = queue->head + queue->count;
+    if (tail >= queue->capacity) {
+        tail -= queue->capacity;
+    }
+    queue->ring[tail] = msg;
+    queue->count++;
+
+    return msg_wake_first(&queue->recv_q, from_isr);
+}
+
+/*
+ * Sends a message. If the queue is full the thread is blocked for at most
+ * `timeout` milliseconds. Returns 1 if the message was sent
+ */
+u8 msg_send(struct msg_queue* queue, void* msg, u32 timeout) {
+    u64 end = get_kernel_tick() + (u64)timeout * SYSTICK_RVR;
+
+    cpsid_i();
+    while (queue->count == queue->capacity) {
+        if (!msg_wait(&queue->send_q, end, timeout)) {
+            cpsie_i();
+            return 0;
+        }
+    }
+
+    struct thread* receiver = msg_put(queue, msg, 0);
+    if (receiver && msg_preempts(receiver)) {
+        reschedule();
+    }
+    cpsie_i();
+
+    return 1;
+}
+
+/*
+ * Sends a message from an exception handler. This never blocks. Returns 0
+ * if the queue is full
+ */
+u8 msg_send_isr(struct msg_queue* queue, void* msg) {
+    u32 primask = cpu_get_primask();
+    cpsid_i();
+    if (queue->count == queue->capacity) {
+        cpu_set_primask(primask);
+        return 0;
+    }
+    msg_put(queue, msg, 1);
+    cpu_set_primask(primask);
+
+    return 1;
+}
+
+/*
+ * Receives the oldest message. If the queue is empty the thread is blocked
+ * for at most `timeout` milliseconds. Returns NULL on timeout
+ */
+void* msg_receive(struct msg_queue* queue, u32 timeout) {
+    u64 end = get_kernel_tick() + (u64)timeout * SYSTICK_RVR;
+
+    cpsid_i();
+    while (queue->count == 0) {
+        if (!msg_wait(&queue->recv_q, end, timeout)) {
+            cpsie_i();
+            return NULL;
+        }
+    }
+
+    void* msg = queue->ring[queue->head];
+    if (++queue->head >= queue->capacity) {
+        queue->head = 0;
+    }
+    queue->count--;
+
+    struct thread* sender = msg_wake_first(&queue->send_q, 0);
+    if (sender && msg_preempts(sender)) {
+        reschedule();
+    }
+    cpsie_i();
+
+    return msg;
+}
+
+u32 msg_queue_count(struct msg_queue* queue) {
+    return queue->count;
+}
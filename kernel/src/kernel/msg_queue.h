@@ -0,0 +1,61 @@
+/* Copyright (C) StrawberryHacker */
+
+#ifndef MSG_QUEUE_H
+#define MSG_QUEUE_H
+
+#include "types.h"
+#include "dlist.h"
+#include "umalloc.h"
+
+/* Timeout values for `msg_send` and `msg_receive` in milliseconds */
+#define MSG_NO_WAIT      0
+#define MSG_WAIT_FOREVER 0xFFFFFFFF
+
+/* Largest ring made by `msg_queue_new` */
+#define MSG_QUEUE_MAX_CAPACITY 4096
+
+/*
+ * Fixed size message queue between threads. Messages are not copied. The
+ * sender allocates a buffer from the message pool of the queue, fills it
+ * and sends the pointer. The receiver gets the same pointer and gives the
+ * buffer back with `msg_free` when it is done. A thread sending to a full
+ * queue, or receiving from an empty queue, is blocked until it can continue
+ * or the timeout expires
+ */
+struct msg_queue {
+    /* Ring of message pointers */
+    void** ring;
+    u32 capacity;
+    u32 head;
+    u32 count;
+
+    /* Threads waiting for room and threads waiting for a message */
+    struct dlist send_q;
+    struct dlist recv_q;
+
+    /* Optional pool of message buffers made by `msg_queue_new` */
+    struct umalloc_desc pool;
+    u32 msg_size;
+    u32 msg_count;
+};
+
+void msg_queue_init(struct msg_queue* queue, void** ring, u32 capacity);
+
+u8 msg_queue_new(struct msg_queue* queue, u32 capacity, u32 msg_size,
+    u32 msg_count);
+
+void msg_queue_delete(struct msg_queue* queue);
+
+void* msg_alloc(struct msg_queue* queue);
+
+void msg_free(struct msg_queue* queue, void* msg);
+
+u8 msg_send(struct msg_queue* queue, void* msg, u32 timeout);
+
+u8 msg_send_isr(struct msg_queue* queue, void* msg);
+
+void* msg_receive(struct msg_queue* queue, u32 timeout);
+
+u32 msg_queue_count(struct msg_queue* queue);
+
+#endif
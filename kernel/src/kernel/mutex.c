@@ -0,0 +1,236 @@
+/* Copyright (C) StrawberryHacker */
+
+#include "mutex.h"
+#include "scheduler.h"
+#include "dlist.h"
+#include "cpu.h"
+#include "panic.h"
+
+#include <stddef.h>
+
+/*
+ * Defined in scheduler.c
+ */
+extern struct thread* curr_thread;
+
+/*
+ * Returns a comparable priority made from the scheduling class and the
+ * priority level. A higher value runs first
+ */
+static u32 mutex_get_prio(struct thread* thread) {
+    u32 rank = SCHED_CLASS_RANK(thread->class->id);
+    return ((SCHED_CLASS_RANK(IDLE) - rank) << 8) | thread->priority;
+}
+
+/*
+ * Returns the priority a thread had when it was created
+ */
+static u32 mutex_get_base_prio(struct thread* thread) {
+    u32 rank = SCHED_CLASS_RANK(thread->base_class->id);
+    return ((SCHED_CLASS_RANK(IDLE) - rank) << 8) | thread->base_priority;
+}
+
+/*
+ * Applies a priority made by `mutex_get_prio` to a thread. A thread can not
+ * inherit the deadline class since it has no deadline parameters. It gets
+ * the highest real-time priority instead. Deadline threads are allready
+ * above all other classes and are never changed
+ */
+static void mutex_set_prio(struct thread* thread, u32 prio) {
+    if (thread->base_class == &deadline_class) {
+        return;
+    }
+
+    if (prio == mutex_get_base_prio(thread)) {
+        scheduler_set_priority(thread, thread->base_class,
+            thread->base_priority);
+        return;
+    }
+
+    u32 rank = SCHED_CLASS_RANK(IDLE) - (prio >> 8);
+    enum sched_class class = (enum sched_class)SCHED_RANK_CLASS(rank);
+    u8 priority = prio & 0xFF;
+
+    if (class == DEADLINE) {
+        class = REAL_TIME;
+        priority = PRIO_RQ_LEVELS - 1;
+    }
+    scheduler_set_priority(thread, scheduler_get_class(class), priority);
+}
+
+/*
+ * Lends the priority `prio` to the owner of a mutex. If the owner itself
+ * waits for another mutex the priority is passed on along the chain
+ */
+static void mutex_boost(struct thread* owner, u32 prio) {
+    for (u32 i = 0; (i < MUTEX_INHERIT_DEPTH) && owner; i++) {
+        if (mutex_get_prio(owner) >= prio) {
+            break;
+        }
+        mutex_set_prio(owner, prio);
+
+        if (owner->blocked_on == NULL) {
+            break;
+        }
+        owner = owner->blocked_on->owner;
+    }
+}
+
+/*
+ * Recomputes the priority of a thread from its base priority and the
+ * priority of all threads waiting for the mutexes it holds
+ */
+static void mutex_update_prio(struct thread* thread) {
+    u32 prio = mutex_get_base_prio(thread);
+
+    struct dlist_node* held = thread->mutexes.first;
+    while (held) {
+        struct mutex* mutex = (struct mutex *)held->obj;
+
+        struct dlist_node* iter = mutex->wait_q.first;
+        while (iter) {
+            u32 waiter_prio = mutex_get_prio((struct thread *)iter->obj);
+            if (waiter_prio > prio) {
+                prio = waiter_prio;
+            }
+            iter = iter->next;
+        }
+        held = held->next;
+    }
+    mutex_set_prio(thread, prio);
+}
+
+static void mutex_set_owner(struct mutex* mutex, struct thread* thread) {
+    mutex->owner = thread;
+    dlist_insert_last(&mutex->held_node, &thread->mutexes);
+}
+
+void mutex_init(struct mutex* mutex) {
+    mutex->owner = NULL;
+    dlist_init(&mutex->wait_q);
+    dlist_node_init(&mutex->held_node);
+    mutex->held_node.obj = mutex;
+}
+
+/*
+ * Locks the mutex. If the mutex is taken the calling thread is blocked
+ * until the mutex is handed over by `mutex_unlock`
+ */
+void mutex_lock(struct mutex* mutex) {
+    struct thread* thread = curr_thread;
+
+    cpsid_i();
+    if (mutex->owner == NULL) {
+        mutex_set_owner(mutex, thread);
+        cpsie_i();
+        return;
+    }
+
+    if (mutex->owner == thread) {
+        panic("Mutex allready held");
+    }
+
+    /* Wait in FIFO order and lend the priority to the owner */
+    dlist_insert_last(&thread->wait_node, &mutex->wait_q);
+    thread->blocked_on = mutex;
+    mutex_boost(mutex->owner, mutex_get_prio(thread));
+
+    /*
+     * The context switch is pended and happens as soon as the interrupts
+     * are enabled. The thread only continues when it has been unblocked
+     */
+    while (mutex->owner != thread) {
+        scheduler_block_thread(thread);
+        cpsie_i();
+        cpsid_i();
+    }
+    cpsie_i();
+}
+
+/*
+ * Tries to lock the mutex without blocking. Returns 1 if the mutex was
+ * locked and 0 if it is taken
+ */
+u8 mutex_try_lock(struct mutex* mutex) {
+    u8 status = 0;
+
+    cpsid_i();
+    if (mutex->owner == NULL) {
+        mutex_set_owner(mutex, curr_thread);
+        status = 1;
+    }
+    cpsie_i();
+
+    return status;
+}
+
+/*
+ * Hands a mutex over to its first waiting thread, or frees it if there
+ * are no waiters. Returns the new owner
+ */
+static struct thread* mutex_hand_over(struct mutex* mutex) {
+    mutex->owner = NULL;
+
+    if (mutex->wait_q.first == NULL) {
+        return NULL;
+    }
+    struct dlist_node* node = dlist_remove_first(&mutex->wait_q);
+    struct thread* next = (struct thread *)node->obj;
+    next->blocked_on = NULL;
+
+    /* The remaining waiters lend their priority to the new owner */
+    mutex_set_owner(mutex, next);
+    mutex_update_prio(next);
+    scheduler_unblock_thread(next);
+
+    return next;
+}
+
+/*
+ * Unlocks the mutex and hands it over to the first waiting thread
+ */
+void mutex_unlock(struct mutex* mutex) {
+    struct thread* thread = curr_thread;
+    struct thread* next = NULL;
+
+    cpsid_i();
+    if (mutex->owner != thread) {
+        panic("Mutex not held");
+    }
+
+    dlist_remove(&mutex->held_node, &thread->mutexes);
+    next = mutex_hand_over(mutex);
+
+    /* Drop the priority inherited through this mutex */
+    mutex_update_prio(thread);
+
+    if (next && (mutex_get_prio(next) > mutex_get_prio(thread))) {
+        reschedule();
+    }
+    cpsie_i();
+}
+
+/*
+ * Cleans up the mutexes of a thread which is exiting. The thread is taken
+ * out of the wait list of the mutex it is blocked on, and every mutex it
+ * holds is handed over to the first waiter. This MUST be called in the
+ * scheduler
+ */
+void mutex_release_all(struct thread* thread) {
+    struct mutex* blocked_on = thread->blocked_on;
+
+    if (blocked_on) {
+        dlist_remove(&thread->wait_node, &blocked_on->wait_q);
+        thread->blocked_on = NULL;
+
+        /* The owner no longer inherits the priority of this thread */
+        if (blocked_on->owner) {
+            mutex_update_prio(blocked_on->owner);
+        }
+    }
+
+    struct dlist_node* node;
+    while ((node = dlist_remove_first(&thread->mutexes))) {
+        mutex_hand_over((struct mutex *)node->obj);
+    }
+}
@@ -0,0 +1,40 @@
+/* Copyright (C) StrawberryHacker */
+
+#ifndef MUTEX_H
+#define MUTEX_H
+
+#include "types.h"
+#include "dlist.h"
+
+/* Maximum length of a priority inheritance chain */
+#define MUTEX_INHERIT_DEPTH 8
+
+/*
+ * Sleeping mutex with priority inheritance. Contended threads are blocked
+ * instead of spinning, and wait in FIFO order. While a thread waits, the
+ * owner inherits its scheduling class and priority if they are higher. The
+ * mutex is handed directly to the first waiter on unlock. A mutex must only
+ * be used from thread context
+ */
+struct mutex {
+    /* Thread holding the mutex. NULL if the mutex is free */
+    struct thread* owner;
+
+    /* Threads waiting for the mutex */
+    struct dlist wait_q;
+
+    /* Node in the owners list of held mutexes */
+    struct dlist_node held_node;
+};
+
+void mutex_init(struct mutex* mutex);
+
+void mutex_lock(struct mutex* mutex);
+
+u8 mutex_try_lock(struct mutex* mutex);
+
+void mutex_unlock(struct mutex* mutex);
+
+void mutex_release_all(struct thread* thread);
+
+#endif
@@ -0,0 +1,72 @@
+/* Copyright (C) StrawberryHacker */
+
+#include "prio_rq.h"
+#include "cpu.h"
+#include "panic.h"
+
+#include <stddef.h>
+
+void prio_rq_init(struct prio_rq* prq) {
+    prq->ready = 0;
+
+    for (u32 i = 0; i < PRIO_RQ_LEVELS; i++) {
+        dlist_init(&prq->level[i]);
+    }
+}
+
+/*
+ * Inserts `node` last in the priority level `prio` and returns the list the
+ * node was placed in. Priorities above the highest level are clamped
+ */
+struct dlist* prio_rq_insert(struct dlist_node* node, u8 prio,
+    struct prio_rq* prq) {
+
+    if (prio >= PRIO_RQ_LEVELS) {
+        prio = PRIO_RQ_LEVELS - 1;
+    }
+
+    struct dlist* list = &prq->level[prio];
+    dlist_insert_last(node, list);
+    prq->ready |= (1 << prio);
+
+    return list;
+}
+
+/*
+ * Removes `node` from `list` which must be one of the priority levels in
+ * `prq`. The ready bit is cleared if the level becomes empty
+ */
+void prio_rq_remove(struct dlist_node* node, struct dlist* list,
+    struct prio_rq* prq) {
+
+    u32 prio = (u32)(list - prq->level);
+    if (prio >= PRIO_RQ_LEVELS) {
+        panic("List not in runqueue");
+    }
+
+    dlist_remove(node, list);
+
+    if (list->first == NULL) {
+        prq->ready &= ~(1 << prio);
+    }
+}
+
+/*
+ * Removes and returns the first node in the highest non-empty priority level.
+ * Returns NULL if the runqueue is empty
+ */
+struct dlist_node* prio_rq_remove_first(struct prio_rq* prq) {
+    if (prq->ready == 0) {
+        return NULL;
+    }
+
+    u32 prio = 31 - cpu_clz(prq->ready);
+    struct dlist* list = &prq->level[prio];
+
+    struct dlist_node* node = dlist_remove_first(list);
+
+    if (list->first == NULL) {
+        prq->ready &= ~(1 << prio);
+    }
+    return node;
+}
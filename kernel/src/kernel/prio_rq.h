@@ -0,0 +1,41 @@
+/* Copyright (C) StrawberryHacker */
+
+#ifndef PRIO_RQ_H
+#define PRIO_RQ_H
+
+#include "types.h"
+#include "dlist.h"
+
+/*
+ * Number of priority levels inside each scheduling class. The ready bitmap
+ * is 32 bits wide so this can not exceed 32
+ */
+#define PRIO_RQ_LEVELS 8
+
+/*
+ * Priority runqueue. Every priority level has its own FIFO `dlist`, and bit
+ * n in `ready` is set as long as level n is non-empty. A higher level means
+ * a higher priority. The highest non-empty level is found with a single CLZ
+ * instruction, so picking the next node costs the same no matter how many
+ * nodes are queued
+ */
+struct prio_rq {
+    u32 ready;
+    struct dlist level[PRIO_RQ_LEVELS];
+};
+
+void prio_rq_init(struct prio_rq* prq);
+
+struct dlist* prio_rq_insert(struct dlist_node* node, u8 prio,
+    struct prio_rq* prq);
+
+void prio_rq_remove(struct dlist_node* node, struct dlist* list,
+    struct prio_rq* prq);
+
+struct dlist_node* prio_rq_remove_first(struct prio_rq* prq);
+
+static inline u8 prio_rq_is_empty(struct prio_rq* prq) {
+    return (prq->ready == 0) ? 1 : 0;
+}
+
+#endif
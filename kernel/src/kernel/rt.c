@@ -3,16 +3,21 @@
 #include "rt.h"
 #include "scheduler.h"
 #include "dlist.h"
+#include "prio_rq.h"
 
 #include <stddef.h>
 
 static struct thread* rt_pick_thread(struct rq* rq) {
-    /* Returns the first item in the `rt_rq` */
-    if (rq->rt_rq.first == NULL) {
+    /* Returns the first item in the highest priority level of `rt_rq` */
+    struct dlist_node* node = prio_rq_remove_first(&rq->rt_rq);
+
+    if (node == NULL) {
         return NULL;
     }
 
-    struct dlist_node* node = dlist_remove_first(&rq->rt_rq);
+    if (prio_rq_is_empty(&rq->rt_rq)) {
+        rq->class_ready &= ~SCHED_CLASS_BIT(REAL_TIME);
+    }
 
     struct thread* th = (struct thread *)node->obj;
 
@@ -22,14 +27,20 @@ static struct thread* rt_pick_thread(struct rq* rq) {
 }
 
 static void rt_enqueue(struct thread* thread, struct rq* rq) {
-    dlist_insert_last(&thread->rq_node, &rq->rt_rq);
-
     /* Update the current list */
-    thread->rq_list = &rq->rt_rq;
+    thread->rq_list = prio_rq_insert(&thread->rq_node, thread->priority,
+        &rq->rt_rq);
+
+    rq->class_ready |= SCHED_CLASS_BIT(REAL_TIME);
 }
 
 static void rt_dequeue(struct thread* thread, struct rq* rq) {
-    dlist_remove(&thread->rq_node, &rq->rt_rq);
+    prio_rq_remove(&thread->rq_node, thread->rq_list, &rq->rt_rq);
+    thread->rq_list = NULL;
+
+    if (prio_rq_is_empty(&rq->rt_rq)) {
+        rq->class_ready &= ~SCHED_CLASS_BIT(REAL_TIME);
+    }
 }
 
 static void rt_block(struct thread* thread, struct rq* rq)
@@ -37,7 +48,13 @@ static void rt_block(struct thread* thread, struct rq* rq)
     if (thread->rq_list == &rq->blocked_q) {
         return;
     }
-    dlist_remove(&thread->rq_node, thread->rq_list); 
+
+    /* The thread is either sleeping or waiting in the runqueue */
+    if (heap_node_is_queued(&thread->sleep_node)) {
+        scheduler_dequeue_delay(thread);
+    } else if (thread->rq_list) {
+        rt_dequeue(thread, rq);
+    }
     dlist_insert_last(&thread->rq_node, &rq->blocked_q);
     thread->rq_list = &rq->blocked_q;
 }
@@ -49,13 +66,12 @@ static void rt_unblock(struct thread* thread, struct rq* rq)
     }
     dlist_remove(&thread->rq_node, thread->rq_list);
     thread->tick_to_wake = 0;
-    dlist_insert_last(&thread->rq_node, &rq->rt_rq);
-    thread->rq_list = &rq->rt_rq;
+    rt_enqueue(thread, rq);
 }
 
 /* Real-time scheduling class */
 const struct scheduling_class rt_class = {
-    .next        = &app_class,
+    .id          = REAL_TIME,
     .pick_thread = rt_pick_thread,
     .enqueue     = rt_enqueue,
     .dequeue     = rt_dequeue,
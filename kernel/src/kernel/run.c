@@ -37,7 +37,7 @@ u8 run_binary(const char* path) {
     if (binary_size & 512) {
         page_count++;
     }
-    u8* binary = (u8 *)pmalloc(page_count, PMALLOC_BANK_1);
+    u8* binary = (u8 *)pcalloc(page_count, PMALLOC_BANK_1);
 
     /*
      * Jump to the start of the file and read the entire binary into
@@ -1,6 +1,7 @@
 /* Copyright (C) StrawberryHacker */
 
 #include "scheduler.h"
+#include "thread.h"
 #include "nvic.h"
 #include "systick.h"
 #include "cpu.h"
@@ -9,6 +10,14 @@
 #include "print.h"
 #include "syscall.h"
 #include "dlist.h"
+#include "deadline.h"
+#include "background.h"
+#include "dwt.h"
+#include "trace.h"
+#include "memory.h"
+#include "mpu.h"
+#include "exclusive.h"
+#include "mutex.h"
 
 #include <stddef.h>
 
@@ -25,8 +34,26 @@ struct thread* next_thread;
 /* Scheduler status tells if the core scheduler is allowed to run */
 volatile u8 scheduler_status;
 
+/* Storage for the sleep queue and deadline runqueue heaps */
+static struct heap_node* sleep_q_nodes[SLEEP_Q_SIZE];
+static struct heap_node* dl_rq_nodes[DEADLINE_MAX_THREADS];
+static struct heap_node* app_rq_nodes[APP_RQ_SIZE];
+
 /* Main runqueue structure */
-struct rq cpu_rq = {0};
+struct rq cpu_rq = {
+	.sleep_q = {
+		.nodes    = sleep_q_nodes,
+		.capacity = SLEEP_Q_SIZE
+	},
+	.dl_rq = {
+		.nodes    = dl_rq_nodes,
+		.capacity = DEADLINE_MAX_THREADS
+	},
+	.app_rq = {
+		.nodes    = app_rq_nodes,
+		.capacity = APP_RQ_SIZE
+	}
+};
 
 /*
  * The tick variable holds the number of CPU cycles since program start.
@@ -42,6 +69,31 @@ volatile u64 tick = 0;
 volatile u64 stats_tick = 0;
 volatile u32 reschedule_pending = 0;
 
+/*
+ * CPU time accounting. `stats_last` is the cycle count when `cpu_stats`
+ * was last brought up to date, and `stats_thread_start` the cycle count
+ * when the current thread was switched in. `stats_isr_slice` holds the
+ * exception handler cycles since then, which the thread is not charged for
+ */
+static struct cpu_stats cpu_stats;
+static u32 stats_last;
+static u32 stats_thread_start;
+static u32 stats_switch_start;
+static u32 stats_isr_start;
+static u32 stats_isr_slice;
+static volatile u32 stats_isr_nesting;
+
+#if STACK_GUARD
+/* The stack guard uses the highest priority MPU region */
+static u8 stack_guard_region;
+#endif
+
+/*
+ * Length of the current SysTick period in CPU cycles. This is SYSTICK_RVR
+ * unless the tickless mode has stretched the period
+ */
+static u32 systick_period = SYSTICK_RVR;
+
 /*
  * The function which is starting the scheduler is defined in contex.s
  * It sets up the stack for the first thread to run, switches from MSP
@@ -60,41 +112,84 @@ static void idle_thread(void* arg) {
 	while (1);
 }
 
+/*
+ * The reaper deletes the threads which have exited. Freeing the memory is
+ * done here instead of in the SysTick handler, since the memory manager can
+ * not be used from exception handlers. The thread runs in the real-time
+ * class, so the memory is given back even if the application threads use
+ * all the CPU time. It is blocked while there is nothing to delete
+ */
+static void reaper_thread(void* arg) {
+	while (1) {
+		cpsid_i();
+		struct dlist_node* node = dlist_remove_first(&cpu_rq.zombies);
+		if (node == NULL) {
+			scheduler_block_thread(curr_thread);
+			cpsie_i();
+			continue;
+		}
+
+		/* From here on the tid is invalid and the exit status is kept */
+		struct thread* thread = (struct thread *)node->obj;
+		thread_table_free(&cpu_rq.thread_table, thread->tid,
+			thread->exit_status);
+		cpsie_i();
+
+		/* Objects the thread made through system calls */
+		syscall_release_thread(thread);
+
+		/* The memory manager must not be used by two threads at once */
+		suspend_scheduler();
+		thread_free(thread);
+		resume_scheduler();
+	}
+}
+
+/*
+ * Scheduling classes indexed by their rank. The lowest rank has the
+ * highest priority
+ */
+static const struct scheduling_class* const sched_classes[] = {
+	[SCHED_CLASS_RANK(DEADLINE)]    = &deadline_class,
+	[SCHED_CLASS_RANK(REAL_TIME)]   = &rt_class,
+	[SCHED_CLASS_RANK(APPLICATION)] = &app_class,
+	[SCHED_CLASS_RANK(BACKGROUND)]  = &background_class,
+	[SCHED_CLASS_RANK(IDLE)]        = &idle_class
+};
+
 /*
  * This is the main core scheduler that picks the next thread to run
- * on the system. It query all the scheduling classes in priority
- * order and return the first thread given. The last scheduling class
- * `idle` must allways have a thread to offer.
+ * on the system. Every scheduling class with a runnable thread has its
+ * bit set in `class_ready`, so the highest priority class is found with
+ * a single CLZ instead of querying every class in turn. The last
+ * scheduling class `idle` must allways have a thread to offer.
  */
-static struct thread* core_scheduler(void) {
-	
-	/* The highest priority scheduler is the real time scheduler */
-	const struct scheduling_class* class;
-	for (class = &rt_class; class != NULL; class = class->next) {
-		struct thread* thread = class->pick_thread(&cpu_rq);
+struct thread* core_scheduler(struct rq* rq) {
+	u32 rank = cpu_clz(rq->class_ready);
 
-		if (thread != NULL) {
-			return thread;
-		}
+	if (rank > SCHED_CLASS_RANK(IDLE)) {
+		panic("Core scheduler error");
+	}
+
+	struct thread* thread = sched_classes[rank]->pick_thread(rq);
+	if (thread == NULL) {
+		panic("Core scheduler error");
 	}
-	panic("Core scheduler error");
-	return NULL;
+	return thread;
 }
 
 /*
- * Returns a thread based on its tid number
+ * Returns a thread based on its tid number. Returns NULL if the thread
+ * has exited or is exiting, since an exiting thread must not be placed in
+ * any scheduler list again
  */
 struct thread* get_thread(struct rq *rq, tid_t tid) {
-	struct dlist_node *it = rq->threads.first;
+	struct thread* thread = thread_table_get(&rq->thread_table, tid);
 
-	while (it) {
-		struct thread *thread = (struct thread *)it->obj;
-		if (thread->tid == tid) {
-			return thread;
-		}
-		it = it->next;
+	if (thread && thread->exit_pending) {
+		return NULL;
 	}
-	return NULL;
+	return thread;
 }
 
 /*
@@ -108,6 +203,11 @@ void scheduler_start(void) {
 	pendsv_set_priority(NVIC_PRI_7);
 	svc_set_priority(NVIC_PRI_5);
 
+	/* The CPU time accounting uses the cycle counter */
+	dwt_enable();
+	stats_last = dwt_get_cycles();
+	stats_thread_start = stats_last;
+
 	/* Allow the scheduler to run */
 	scheduler_status = 1;
 	cpu_rq.tick_to_wake = 0;
@@ -125,12 +225,24 @@ void scheduler_start(void) {
 	tid_t idle_tid = new_thread(&idle_info);
 	cpu_rq.idle = get_thread(&cpu_rq, idle_tid);
 
+	/* Add the reaper thread deleting exited threads */
+	struct thread_info reaper_info = {
+		.name       = "Reaper",
+		.stack_size = 128,
+		.thread     = reaper_thread,
+		.arg        = NULL,
+		.class      = REAL_TIME,
+		.priority   = REAPER_PRIORITY
+	};
+	tid_t reaper_tid = new_thread(&reaper_info);
+	cpu_rq.reaper = get_thread(&cpu_rq, reaper_tid);
+
 	/*
 	 * The `scheduler_run` does not care about the `curr_thread`.
 	 * However it MUST be set in order for the cotext switch to work.
 	 * If the `curr_thread` is not set, this will give an hard fault.
 	 */
-	next_thread = core_scheduler();
+	next_thread = core_scheduler(&cpu_rq);
 	curr_thread = next_thread;
 
 	/* Check if the idle thread is present */
@@ -138,6 +250,28 @@ void scheduler_start(void) {
 		panic("Idle not present");
 	}
 
+#if STACK_GUARD
+	/*
+	 * The guard region denies all access and is placed on top of the
+	 * default memory map, which is still used for everything else
+	 */
+	struct mpu_region guard = {
+		.size           = 4,
+		.ap             = 0b000,
+		.tex            = 0b000,
+		.c              = 0,
+		.b              = 0,
+		.s              = 0,
+		.executable     = 0,
+		.enable         = 1,
+		.subregion_mask = 0
+	};
+	stack_guard_region = mpu_get_data_regions() - 1;
+	mpu_configure_region(stack_guard_region, curr_thread->stack_guard, &guard);
+	mpu_enable_priv_access();
+	mpu_enable();
+#endif
+
 	/*
 	 * Disable interrupt and enable the systick. When the `scheduler_run`
 	 * assembly code turns on fault exceptions at the very end, systick
@@ -156,10 +290,10 @@ void scheduler_start(void) {
  * sleep queue is empty the `tick_to_wake` will be written to zero
  */
 static void tick_to_wake_update(void) {
-	/* Update the first tick to wake */
-	struct dlist_node* tmp = cpu_rq.sleep_q.first;
-	if (tmp) {
-		cpu_rq.tick_to_wake = ((struct thread *)tmp->obj)->tick_to_wake;
+	/* The root of the sleep heap allways has the first tick to wake */
+	struct heap_node* first = heap_get_first(&cpu_rq.sleep_q);
+	if (first) {
+		cpu_rq.tick_to_wake = first->key;
 	} else {
 		cpu_rq.tick_to_wake = 0;
 	}
@@ -169,85 +303,135 @@ static void process_expired_delays(void) {
 	
 	if ((cpu_rq.tick_to_wake <= tick) && cpu_rq.tick_to_wake) {
 		/*
-		 * Go over the delay queue and and enqueue all expired thread
-		 * in their scheduling class
+		 * Pop expired threads from the sleep heap and enqueue them in
+		 * their scheduling class. At most SLEEP_Q_WAKE_MAX threads are
+		 * woken per exception so the time spent here is bounded
 		 */
-		struct dlist_node* iter = cpu_rq.sleep_q.first;
+		u32 count = SLEEP_Q_WAKE_MAX;
+		struct heap_node* first = heap_get_first(&cpu_rq.sleep_q);
 
-		while (iter) {
-			u64 tick_to_wake = ((struct thread *)iter->obj)->tick_to_wake;
-			if (tick_to_wake < tick) {
+		while (first && (first->key <= tick) && count--) {
+			heap_remove_first(&cpu_rq.sleep_q);
 
-				/* Remove the thread for the delay queue */
-				dlist_remove(iter, &cpu_rq.sleep_q);
-				((struct thread *)iter->obj)->rq_list = NULL;
+			/* Place the thread back into the running list */
+			struct thread* t = (struct thread *)first->obj;
+			t->tick_to_wake = 0;
+			trace(TRACE_WAKE, t->tid, 0);
 
-				/* Place the thread back into the running list */
-				struct thread* t = (struct thread *)iter->obj;
-				t->class->enqueue(t, &cpu_rq);
-				t->tick_to_wake = 0;
+			/* A blocked thread waiting with a timeout has timed out */
+			if (t->rq_list == &cpu_rq.blocked_q) {
+				t->class->unblock(t, &cpu_rq);
 			} else {
-				/*
-				 * The tick to wake is higher than the current kernel tick.
-				 * It should not be removed from the sleep_q
-				 */
-				break;
+				t->class->enqueue(t, &cpu_rq);
 			}
-			iter = iter->next;
+
+			first = heap_get_first(&cpu_rq.sleep_q);
 		}
 		tick_to_wake_update();
 	}
 }
 
-/* 
- * Remove a thread completly from the system. This includes deleting
- * the code and the thread control block. It will also remove the
- * thread from all list. This MUST be called in the scheduler.
+/*
+ * Returns 1 if the thread is waiting in the runqueue of its scheduling
+ * class, i.e. it is neither running, sleeping nor blocked
  */
-static void scheduler_remove_thread(struct thread* thread) {
+static u8 scheduler_thread_is_queued(struct thread* thread)
+{
+	if (thread->class == &deadline_class) {
+		return heap_node_is_queued(&thread->dl_node);
+	}
+	if (thread->class == &app_class) {
+		return heap_node_is_queued(&thread->app_node);
+	}
+	if (thread->class == &idle_class) {
+		return 0;
+	}
+	return (thread->rq_list != NULL) && (thread->rq_list != &cpu_rq.blocked_q);
+}
 
-	/* Remove the threads from all the lists */
-	dlist_remove(&curr_thread->thread_node, &cpu_rq.threads);
+/*
+ * Moves a blocked thread into its runqueue. A thread blocked with a timeout
+ * is removed from the sleep queue as well
+ */
+static void scheduler_wake_blocked(struct thread* thread) {
+	if (thread->rq_list != &cpu_rq.blocked_q) {
+		return;
+	}
+	if (heap_node_is_queued(&thread->sleep_node)) {
+		scheduler_dequeue_delay(thread);
+	}
+	trace(TRACE_UNBLOCK, thread->tid, 0);
+	thread->class->unblock(thread, &cpu_rq);
+}
 
-	if (curr_thread->rq_list) {
-		dlist_remove(&curr_thread->rq_node, curr_thread->rq_list);
+/*
+ * Unblocks the threads which exception handlers have requested to wake
+ */
+static void process_isr_wakeups(void) {
+	struct mpsc_node* node = mpsc_take_all(&cpu_rq.isr_wake_q);
+
+	while (node) {
+		struct mpsc_node* next = node->next;
+		struct thread* thread = (struct thread *)node->obj;
+
+		/* From here on the thread might be pushed again */
+		thread->isr_wake_pending = 0;
+
+		scheduler_wake_blocked(thread);
+		node = next;
+	}
+}
+
+/*
+ * Removes the current thread from all scheduler lists and hands it over to
+ * the reaper thread. The thread keeps its tid until it is deleted. This
+ * MUST be called in the scheduler
+ */
+static void scheduler_zombie_thread(struct thread* thread) {
+	dlist_remove(&thread->thread_node, &cpu_rq.threads);
+
+	/* The thread might have been throttled by the tick of its class */
+	if (scheduler_thread_is_queued(thread)) {
+		thread->class->dequeue(thread, &cpu_rq);
+	} else if (thread->rq_list) {
+		dlist_remove(&thread->rq_node, thread->rq_list);
+		thread->rq_list = NULL;
+	}
+	if (heap_node_is_queued(&thread->sleep_node)) {
+		scheduler_dequeue_delay(thread);
+	}
+
+	/* Give back the reserved utilization of a deadline thread */
+	if (thread->class == &deadline_class) {
+		deadline_release(thread, &cpu_rq);
+	}
+
+	/* Hand the mutexes the thread still holds over to their waiters */
+	mutex_release_all(thread);
+
+	/* Nothing must wake the thread through a waiter on its stack */
+	if (thread->wait_list) {
+		dlist_remove(thread->wait_entry, thread->wait_list);
+		thread->wait_list = NULL;
 	}
 
 	/* Verify that the thread does not exits in any list */
-	if ((curr_thread->rq_node.next != NULL) || 
-	    (curr_thread->rq_node.prev != NULL) ||
-		(curr_thread->thread_node.next != NULL) ||
-		(curr_thread->thread_node.prev != NULL)) {
+	if ((thread->rq_node.next != NULL) || 
+	    (thread->rq_node.prev != NULL) ||
+		(thread->thread_node.next != NULL) ||
+		(thread->thread_node.prev != NULL)) {
 		panic("Exiting thread exist in a list");
 	}
 
-	/* Delete the threads memory footprint */
-	if (curr_thread->code_addr) {
-		mm_free(curr_thread->code_addr);
+	dlist_insert_last(&thread->thread_node, &cpu_rq.zombies);
+	if (cpu_rq.reaper) {
+		scheduler_wake_blocked(cpu_rq.reaper);
 	}
-	
-	/* Delete the thread control block */
-	mm_free((void *)curr_thread);
 
 	/* This tells the context switcher to skip stack saving */
 	curr_thread = NULL;
 }
 
-/*
- * This functions goes over all the threads and saves the new 
- * runtime window into current runtime. 
- */
-static void calculate_runtime(void) {
-	struct dlist_node* iter = cpu_rq.threads.first;
-
-	while (iter != NULL) {
-		struct thread* t = (struct thread *)iter->obj;
-		t->runtime_curr = t->runtime_new;
-		t->runtime_new = 0;
-		iter = iter->next;
-	}
-}
-
 /*
  * Returns the current runtime of the current thread
  */
@@ -259,20 +443,71 @@ static u64 get_curr_thread_runtime(void) {
 
 		/* Calculate the runtime */
 		u32 cvr = systick_get_cvr();
-		curr_runtime = (u64)(SYSTICK_RVR - cvr);
+		curr_runtime = (u64)(systick_period - cvr);
 	} else {
-		/* No reschedule is pending so the runtime is SYSTICK_RVR */
-		curr_runtime = SYSTICK_RVR;
+		/* No reschedule is pending so the runtime is the whole period */
+		curr_runtime = systick_period;
 	}
 
 	return curr_runtime;
 }
 
 /*
- * This calls the scheduler. It is called every millisecond or
- * after a reschedule.
+ * Returns the length of the next SysTick period. If the idle thread is the
+ * only runnable thread there is no reason to tick until the first sleeping
+ * thread wakes up. The period is never stretched beyond the runtime 
+ * statistics window, so the statistics stays correct
+ */
+static u32 get_next_period(void) {
+#if SCHEDULER_TICKLESS
+	if (next_thread != cpu_rq.idle) {
+		return SYSTICK_RVR;
+	}
+
+	u64 period = SYSTICK_RVR_MAX;
+
+	if (cpu_rq.tick_to_wake) {
+		u64 delta = 0;
+		if (cpu_rq.tick_to_wake > tick) {
+			delta = cpu_rq.tick_to_wake - tick;
+		}
+		if (delta < period) {
+			period = delta;
+		}
+	}
+
+	/* A throttled background thread is replenished on time */
+	if (cpu_rq.bg_throttled.first) {
+		u64 delta = 0;
+		if (cpu_rq.bg_replenish_tick > tick) {
+			delta = cpu_rq.bg_replenish_tick - tick;
+		}
+		if (delta < period) {
+			period = delta;
+		}
+	}
+
+	if (STATS_WINDOW - stats_tick < period) {
+		period = STATS_WINDOW - stats_tick;
+	}
+
+	if (period < SYSTICK_RVR_MIN) {
+		period = SYSTICK_RVR_MIN;
+	}
+	return (u32)period;
+#else
+	return SYSTICK_RVR;
+#endif
+}
+
+/*
+ * This calls the scheduler. It is called every millisecond, after a
+ * reschedule or when a stretched tickless period ends.
  */
 void systick_exception(void) {
+	u32 systick_start = dwt_get_cycles();
+	scheduler_isr_enter();
+
 	if (scheduler_status) {
 		cpsid_f();
 
@@ -280,34 +515,53 @@ void systick_exception(void) {
 
 		tick += curr_runtime;
 		stats_tick += curr_runtime;
-		curr_thread->runtime_new += curr_runtime;
 
-		/* Every second the scheduler will calulate the thread new runtime */
-		if (stats_tick >= SYSTICK_RVR * 1000) {
-			stats_tick = 0;
+		/* Let the scheduling class charge the runtime */
+		if (curr_thread->class->tick) {
+			curr_thread->class->tick((struct thread *)curr_thread, &cpu_rq,
+				curr_runtime);
+		}
+
+		/* Toggle the heartbeat LED every second */
+		if (stats_tick >= STATS_WINDOW) {
+			stats_tick -= STATS_WINDOW;
 			gpio_toggle(GPIOC, 8);
-			calculate_runtime();
 		}
 		
+		process_isr_wakeups();
 		process_expired_delays();
-
-		/* Enqueue the thread */
-		if (curr_thread->tick_to_wake == 0) {
-			/* The current thread has to be enqueued again */
-			curr_thread->class->enqueue((struct thread *)curr_thread, &cpu_rq);
-		}
+		background_replenish(&cpu_rq);
 
 		/*
 		 * Check if the thread should be removed. No reference to
 		 * curr_thread should be performed after this point. 
 		 */
+		tid_t prev_tid = curr_thread->tid;
 		if (curr_thread->exit_pending) {
-			scheduler_remove_thread(curr_thread);
+			prev_tid = 0;
+			scheduler_zombie_thread(curr_thread);
+		} else if (!heap_node_is_queued(&curr_thread->sleep_node) &&
+		           (curr_thread->rq_list != &cpu_rq.blocked_q) &&
+		           !scheduler_thread_is_queued(curr_thread)) {
+			/*
+			 * The current thread has to be enqueued again, unless it
+			 * went to sleep or blocked, or it has allready been woken
+			 * or unblocked since and placed in a runqueue
+			 */
+			curr_thread->class->enqueue((struct thread *)curr_thread, &cpu_rq);
 		}
 
 		/* Call the core scheduler */
-		next_thread = core_scheduler();
-		systick_set_cvr(SYSTICK_RVR);
+		next_thread = core_scheduler(&cpu_rq);
+		trace(TRACE_SWITCH, prev_tid, next_thread->tid);
+
+		/*
+		 * Start a new period. Writing the CVR clears the counter so it
+		 * reloads from the RVR on the next clock
+		 */
+		systick_period = get_next_period();
+		systick_set_rvr(systick_period);
+		systick_set_cvr(0);
 		cpsie_f();
 
 		/* Pend the context switch */
@@ -315,6 +569,13 @@ void systick_exception(void) {
 	} else {
 		//print("x");
 	}
+
+	scheduler_isr_exit();
+
+	u32 systick_cycles = dwt_get_cycles() - systick_start;
+	if (systick_cycles > cpu_stats.systick_max_cycles) {
+		cpu_stats.systick_max_cycles = systick_cycles;
+	}
 }
 
 /*
@@ -327,37 +588,14 @@ void reschedule(void) {
 }
 
 /*
- * This will enqueue the thread into the sorted `sleep_q` list. The
- * first node will have to lowest tick to wake
+ * This will enqueue the thread into the `sleep_q` heap. The insertion is
+ * O(log n) in the number of sleeping threads
  */
 void scheduler_enqueue_delay(struct thread* thread) {
-	struct dlist_node* iter = cpu_rq.sleep_q.first;
+	trace(TRACE_SLEEP, thread->tid, (u32)(thread->tick_to_wake - tick));
 
-	if (iter == NULL) {
-		dlist_insert_first(&thread->rq_node, &cpu_rq.sleep_q);
-
-	} else {
-		while (iter != NULL) {
-			/*
-			 * Check if the `iter` node has a higher `tick_to_wake`
-			 * value than the thread to insert. If that is the case,
-			 * insert the thread before `iter`
-			 */
-			struct thread* t = (struct thread *)iter->obj;
-			if (t->tick_to_wake > thread->tick_to_wake) {
-				dlist_insert_before(&thread->rq_node, iter, &cpu_rq.sleep_q);
-				break;
-			}
-			iter = iter->next;
-		}
-
-		if (iter == NULL) {
-			dlist_insert_last(&thread->rq_node, &cpu_rq.sleep_q);
-		}
-	}
-
-	/* Update the thread list */
-	thread->rq_list = &cpu_rq.sleep_q;
+	thread->sleep_node.key = thread->tick_to_wake;
+	heap_insert(&thread->sleep_node, &cpu_rq.sleep_q);
 
 	/*
 	 * If the new thread is placed first in the sleep queue, the first
@@ -366,6 +604,14 @@ void scheduler_enqueue_delay(struct thread* thread) {
 	tick_to_wake_update();
 }
 
+/*
+ * Removes a sleeping thread from the `sleep_q` heap before it expires
+ */
+void scheduler_dequeue_delay(struct thread* thread) {
+	heap_remove(&thread->sleep_node, &cpu_rq.sleep_q);
+	tick_to_wake_update();
+}
+
 void suspend_scheduler(void) {
 	scheduler_status = 0;
 }
@@ -378,30 +624,253 @@ u64 get_kernel_tick(void) {
 	return tick;
 }
 
-u64 get_idle_runtime(void) {
-	return cpu_rq.idle->runtime_curr;
+/*
+ * Brings the total cycle count up to date. This is called at least once
+ * every SysTick period, so the 32-bit cycle counter can not wrap twice
+ * between two calls
+ */
+static inline void stats_update(u32 now) {
+	cpu_stats.cycles += (u32)(now - stats_last);
+	stats_last = now;
+}
+
+/*
+ * Marks the start and the end of an exception handler which should not be
+ * charged to the running thread. Nested handlers are counted once
+ */
+void scheduler_isr_enter(void) {
+	if (stats_isr_nesting++ == 0) {
+		stats_isr_start = dwt_get_cycles();
+	}
+}
+
+void scheduler_isr_exit(void) {
+	if (--stats_isr_nesting == 0) {
+		u32 cycles = dwt_get_cycles() - stats_isr_start;
+		stats_isr_slice += cycles;
+		cpu_stats.isr_cycles += cycles;
+	}
+}
+
+/*
+ * Returns the exception handler cycles since the last call and starts a new
+ * count. Interrupts are disabled so a handler ending in between is not lost
+ */
+static inline u32 stats_take_isr_slice(u32* now) {
+	u32 primask = cpu_get_primask();
+	cpsid_i();
+
+	*now = dwt_get_cycles();
+	u32 slice = stats_isr_slice;
+	stats_isr_slice = 0;
+
+	cpu_set_primask(primask);
+	return slice;
+}
+
+/*
+ * Called from the PendSV handler before the context switch. Charges the
+ * current thread for the time it has run since it was switched in
+ */
+void scheduler_switch_begin(void) {
+	u32 now;
+	u32 isr_slice = stats_take_isr_slice(&now);
+	stats_update(now);
+
+	if (curr_thread) {
+		curr_thread->cycles += (u32)(now - stats_thread_start) - isr_slice;
+	}
+	stats_switch_start = now;
+}
+
+/*
+ * Called from the PendSV handler after the context switch
+ */
+void scheduler_switch_end(void) {
+	u32 now;
+	u32 isr_slice = stats_take_isr_slice(&now);
+	stats_update(now);
+
+	cpu_stats.switch_cycles += (u32)(now - stats_switch_start) - isr_slice;
+	cpu_stats.switch_count++;
+	curr_thread->switch_count++;
+
+#if STACK_GUARD
+	/* Protect the memory right below the stack of the new thread */
+	mpu_move_region(stack_guard_region, curr_thread->stack_guard);
+#endif
+
+	stats_thread_start = now;
+}
+
+/*
+ * Copies the CPU accounting into `stats`. Utilization is computed by the
+ * caller from the difference between two snapshots
+ */
+void scheduler_get_cpu_stats(struct cpu_stats* stats) {
+	cpsid_i();
+	stats_update(dwt_get_cycles());
+	*stats = cpu_stats;
+	cpsie_i();
+}
+
+/*
+ * Starts a new measurement of the longest SysTick handler
+ */
+void scheduler_reset_isr_max(void) {
+	cpsid_i();
+	cpu_stats.systick_max_cycles = 0;
+	cpsie_i();
+}
+
+/*
+ * Copies the accounting of a single thread into `stats`. The running
+ * thread also gets the cycles of its current time slice. Returns 0 if the
+ * thread does not exist
+ */
+u8 scheduler_get_thread_stats(tid_t tid, struct thread_stats* stats) {
+	cpsid_i();
+
+	struct thread* thread = get_thread(&cpu_rq, tid);
+	if (thread == NULL) {
+		cpsie_i();
+		return 0;
+	}
+
+	memory_copy(thread->name, stats->name, THREAD_MAX_NAME_LEN);
+	stats->class = thread->class->id;
+	stats->cycles = thread->cycles;
+	stats->switch_count = thread->switch_count;
+
+	if (thread == curr_thread) {
+		stats->cycles += (u32)(dwt_get_cycles() - stats_thread_start) - 
+			stats_isr_slice;
+	}
+	cpsie_i();
+
+	return 1;
 }
 
+/*
+ * Moves a blocked thread back into the runqueue of its scheduling class
+ */
 void scheduler_unblock_thread(struct thread* thread)
 {
-	if (thread == curr_thread) {
+	scheduler_wake_blocked(thread);
+
+	/*
+	 * The idle thread might be running in a stretched tickless period.
+	 * Reschedule so the unblocked thread does not have to wait for it
+	 */
+	if (curr_thread == cpu_rq.idle) {
 		reschedule();
 	}
-	if (thread == curr_thread) {
-		panic("ERROR");
+}
+
+/*
+ * Unblocks a thread from an exception handler of any priority. The thread
+ * is unblocked by the next SysTick exception, which is pended right away.
+ * Unblocking a thread which is not blocked has no effect
+ */
+void scheduler_unblock_thread_isr(struct thread* thread)
+{
+	u32 pending;
+	do {
+		pending = ldrex(&thread->isr_wake_pending);
+	} while (strex(&thread->isr_wake_pending, 1));
+
+	if (pending == 0) {
+		mpsc_push(&thread->isr_wake_node, &cpu_rq.isr_wake_q);
 	}
-	/* The CPU thread to block do not run anymore */
-	thread->class->unblock(thread, &cpu_rq);
+	reschedule();
 }
 
+/*
+ * Moves a thread into the blocked queue. If the thread is the current
+ * running thread a reschedule is triggered. If the caller has disabled
+ * interrupts the context switch happens when they are enabled again
+ */
 void scheduler_block_thread(struct thread* thread)
 {
+	if (thread->class->block == NULL) {
+		panic("Thread can not block");
+	}
+
+	/* An exiting thread keeps running until the SysTick removes it */
+	if (thread->exit_pending) {
+		return;
+	}
+	trace(TRACE_BLOCK, thread->tid, 0);
+	thread->class->block(thread, &cpu_rq);
+
 	if (thread == curr_thread) {
 		reschedule();
 	}
-	if (thread == curr_thread) {
-		panic("ERROR");
+}
+
+/*
+ * Blocks a thread like `scheduler_block_thread`, but the thread is unblocked
+ * by the scheduler if it is still blocked after `timeout` ticks
+ */
+void scheduler_block_thread_timeout(struct thread* thread, u64 timeout)
+{
+	if (thread->exit_pending) {
+		return;
 	}
-	/* The CPU thread to block do not run anymore */
-	thread->class->block(thread, &cpu_rq);
+	scheduler_block_thread(thread);
+
+	thread->tick_to_wake = tick + timeout;
+	scheduler_enqueue_delay(thread);
+}
+
+/*
+ * Makes a thread exit with `status`. Only the running thread is handed over
+ * to the reaper, so a blocked or sleeping thread is woken and exits the next
+ * time it runs. It can not block or sleep again. This MUST be called with
+ * the scheduler suspended
+ */
+void scheduler_kill_thread(struct thread* thread, u32 status)
+{
+	thread->exit_status = status;
+	thread->exit_pending = 1;
+
+	if (thread->rq_list == &cpu_rq.blocked_q) {
+		scheduler_wake_blocked(thread);
+	} else if (heap_node_is_queued(&thread->sleep_node)) {
+		scheduler_dequeue_delay(thread);
+		if (!scheduler_thread_is_queued(thread)) {
+			thread->class->enqueue(thread, &cpu_rq);
+		}
+	}
+}
+
+/*
+ * Changes the scheduling class and priority of a thread. A thread waiting
+ * in a runqueue is moved to the new runqueue. A running, sleeping or
+ * blocked thread is enqueued in the new class the next time it is enqueued
+ */
+void scheduler_set_priority(struct thread* thread,
+	const struct scheduling_class* class, u8 priority)
+{
+	if ((thread->class == class) && (thread->priority == priority)) {
+		return;
+	}
+
+	if (scheduler_thread_is_queued(thread)) {
+		thread->class->dequeue(thread, &cpu_rq);
+		thread->class = class;
+		thread->priority = priority;
+		thread->class->enqueue(thread, &cpu_rq);
+	} else {
+		thread->class = class;
+		thread->priority = priority;
+	}
+}
+
+/*
+ * Returns the scheduling class given its `sched_class` number
+ */
+const struct scheduling_class* scheduler_get_class(enum sched_class class)
+{
+	return sched_classes[SCHED_CLASS_RANK(class)];
 }
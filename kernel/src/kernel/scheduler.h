@@ -6,18 +6,119 @@
 #include "types.h"
 #include "list.h"
 #include "dlist.h"
+#include "prio_rq.h"
+#include "heap.h"
+#include "thread_table.h"
+#include "mpsc.h"
 
 #define SYSTICK_RVR 300000
+
+/*
+ * In tickless mode the SysTick period is stretched when the idle thread is
+ * the only runnable thread. The period is then limited by the first tick to
+ * wake, the first throttled background thread to replenish, the runtime
+ * statistics window and the 24-bit reload register
+ */
+#define SCHEDULER_TICKLESS 1
+#define SYSTICK_RVR_MAX 0xFFFFFF
+#define SYSTICK_RVR_MIN 3000
+
+/*
+ * EXC_RETURN for returning to thread mode using the PSP. Bit 4 is cleared
+ * when the exception stack frame contains floating point registers
+ */
+#define EXC_RETURN_THREAD_PSP     0xFFFFFFFD
+#define EXC_RETURN_THREAD_PSP_FPU 0xFFFFFFED
+
+/*
+ * The whole stack of a thread is painted with THREAD_STACK_PAINT when it is
+ * created. The deepest point the stack has reached is found by looking for
+ * the first word from the bottom which has been overwritten
+ */
+#define THREAD_STACK_PAINT 0xCAFECAFE
+
+/*
+ * If STACK_GUARD is set a no-access MPU region of STACK_GUARD_SIZE bytes is
+ * placed right below the stack of the running thread, so a stack overflow
+ * gives a memory management fault instead of corrupting the memory below.
+ * The region is moved on every context switch
+ */
+#define STACK_GUARD 1
+#define STACK_GUARD_SIZE 32
+
+/* Number of thread control blocks added to the thread cache at a time */
+#define THREAD_SLAB_OBJECTS 8
+
+/* The heartbeat LED is toggled once every second */
+#define STATS_WINDOW ((u64)SYSTICK_RVR * 1000)
+
+/*
+ * Maximum number of sleeping threads, and the maximum number of expired
+ * threads woken in one SysTick exception. The rest are woken on the next
+ */
+#define SLEEP_Q_SIZE 1024
+#define SLEEP_Q_WAKE_MAX 8
+
+/*
+ * Maximum number of deadline threads, and the maximum total density of the
+ * deadline threads in per mille. The density of a thread is its runtime
+ * over the shorter of its deadline and period. A new deadline thread is
+ * rejected if it would make the total density exceed this bound
+ */
+#define DEADLINE_MAX_THREADS 32
+#define DEADLINE_UTIL_MAX 900
+
+/*
+ * Application threads share the CPU in proportion to their weight. The
+ * default weight is APP_WEIGHT_DEFAULT and is limited to the range below.
+ * A thread waking up is given at most APP_SLEEPER_CREDIT ticks of virtual
+ * runtime ahead of the threads which kept running
+ */
+#define APP_RQ_SIZE THREAD_TABLE_SIZE
+#define APP_WEIGHT_DEFAULT 1024
+#define APP_WEIGHT_MIN 16
+#define APP_WEIGHT_MAX 16384
+#define APP_SLEEPER_CREDIT ((u64)SYSTICK_RVR * 3)
+
 #define THREAD_MAX_NAME_LEN 32
 
+/* Exit status of a thread returning from its thread function or killed */
+#define THREAD_EXIT_NORMAL 0
+#define THREAD_EXIT_KILLED 1
+
+/*
+ * Priority of the reaper thread in the real-time class. This is the lowest
+ * level, so the reaper only delays other real-time threads briefly, but
+ * CPU-bound application threads can not starve it
+ */
+#define REAPER_PRIORITY 0
+
+/*
+ * Scheduling class numbers. These are stored in application headers, so
+ * new classes are added at the end. The order in which the classes run is
+ * given by their rank instead
+ */
 enum sched_class {
     REAL_TIME,
     APPLICATION,
     BACKGROUND,
-    IDLE
+    IDLE,
+    DEADLINE
 };
 
-typedef uint32_t tid_t;
+/*
+ * Rank of a scheduling class, the lowest rank running first, and the
+ * scheduling class with a given rank. The deadline class runs before all
+ * the others
+ */
+#define SCHED_CLASS_RANK(class) (((class) == DEADLINE) ? 0 : (class) + 1)
+#define SCHED_RANK_CLASS(rank) (((rank) == 0) ? DEADLINE : (rank) - 1)
+
+/*
+ * Bit in the `class_ready` bitmap which belongs to a scheduling class. The
+ * bit is placed so that CLZ returns the rank of the class directly
+ */
+#define SCHED_CLASS_BIT(class) (1u << (31 - SCHED_CLASS_RANK(class)))
 
 /*
  * Info structure used for initializing new threads
@@ -36,6 +137,31 @@ struct thread_info {
 
     enum sched_class class;
 
+    /*
+     * Priority level inside the scheduling class. A higher value is a higher
+     * priority. Must be less than PRIO_RQ_LEVELS
+     */
+    u8 priority;
+
+    /*
+     * Deadline class parameters in milliseconds. The thread is guaranteed
+     * `runtime` of CPU time within `deadline` from the start of every
+     * `period`. If `deadline` is zero it is equal to the `period`
+     *
+     * A background thread with a non-zero `runtime` gets at most `runtime`
+     * of CPU time in every `period`. It is throttled for the rest of the
+     * period when the quota is used up
+     */
+    u32 runtime;
+    u32 period;
+    u32 deadline;
+
+    /*
+     * Application class weight. Threads of the same priority get CPU time
+     * in proportion to their weight. Zero gives APP_WEIGHT_DEFAULT
+     */
+    u32 weight;
+
     /*
      * Optional code address. If the code is dynamically allocated
      * set this variable to the base address of the code segment
@@ -47,17 +173,55 @@ struct thread_info {
  * Main CPU runqueue structure
  */
 struct rq {
-    struct dlist app_rq;
-    struct dlist background_rq;
-    struct dlist rt_rq;
+    /* Ready deadline threads ordered by their absolute deadline */
+    struct heap dl_rq;
+
+    /* Ready application threads ordered by priority and virtual runtime */
+    struct heap app_rq;
+    u64 app_min_vruntime;
+
+    struct prio_rq background_rq;
+    struct prio_rq rt_rq;
     
     struct thread* idle;
 
-    struct dlist sleep_q;
+    /*
+     * Bitmap of the scheduling classes with at least one runnable thread.
+     * See SCHED_CLASS_BIT
+     */
+    u32 class_ready;
+
+    /*
+     * Background threads which have used up their quota, ordered by the
+     * tick they are replenished on. `bg_replenish_tick` is the first of
+     * these if the list is non-empty
+     */
+    struct dlist bg_throttled;
+    u64 bg_replenish_tick;
+
+    /* Sleeping threads ordered by their tick to wake */
+    struct heap sleep_q;
     struct dlist blocked_q;
 
+    /* Threads unblocked from exception handlers. See `isr_wake_node` */
+    struct mpsc isr_wake_q;
+
     struct dlist threads;
 
+    /*
+     * Threads which have exited but not yet been deleted. The memory is
+     * freed by the reaper thread, so the SysTick handler does not have to
+     */
+    struct dlist zombies;
+    struct thread* reaper;
+
+    /* All threads indexed by tid */
+    struct thread_table thread_table;
+
+    /* Total density of the admitted deadline threads in per mille */
+    u32 dl_util;
+    u32 dl_count;
+
     /*
      * If the sleep queue is non-empty `tick_to_wake` holds the first tick to
      * wake on. Several sleeping threads might have the same tick to wake but 
@@ -74,29 +238,111 @@ struct thread {
     u32* stack_pointer;
     u32* stack_base;
 
+    /*
+     * EXC_RETURN value of the thread. Bit 4 is cleared if the thread has an
+     * active floating point context. Then the exception stack frame is
+     * extended with S0-S15 and FPSCR, and the context switch stacks S16-S31.
+     * This is accessed by the context switch at offset 8
+     */
+    u32 exc_return;
+
+    /* Stack size in words and the address of the MPU stack guard */
+    u32 stack_size;
+    u32 stack_guard;
+
+    /* Memory allocated for the stack and the stack guard */
+    void* stack_mem;
+
     /* Runqueue list node */
     struct dlist* rq_list;
     struct dlist_node rq_node;
     struct dlist_node thread_node;
 
+    /* Sleep queue node. The key is the tick to wake */
+    struct heap_node sleep_node;
+
     /* Pointer to the threads current scheduling class */
     const struct scheduling_class* class;
 
+    /* Priority level inside the scheduling class */
+    u8 priority;
+
+    /*
+     * Scheduling class and priority given at creation. The class and
+     * priority above might be temporarily boosted by priority inheritance
+     */
+    const struct scheduling_class* base_class;
+    u8 base_priority;
+
+    /* Mutexes held by the thread, and the mutex it is waiting for */
+    struct dlist mutexes;
+    struct mutex* blocked_on;
+    struct dlist_node wait_node;
+
+    /*
+     * Waiter node on the stack of the thread, and the wait list holding it,
+     * while it waits on a message queue or the console. An exiting thread
+     * is taken out of the list before its stack is freed
+     */
+    struct dlist* wait_list;
+    struct dlist_node* wait_entry;
+
+    /*
+     * Exception handlers can not modify the runqueues directly since they
+     * might preempt the scheduler. They push the thread onto `isr_wake_q`
+     * instead, and the SysTick handler unblocks it
+     */
+    struct mpsc_node isr_wake_node;
+    volatile u32 isr_wake_pending;
+
     /* Name of the thread */
     char name[THREAD_MAX_NAME_LEN];
     u8 name_len;
 
     u64 tick_to_wake;
 
-    /* Variables used for calulating runtime statistics */
-    u64 runtime_curr;
-    u64 runtime_new;
+    /*
+     * Deadline class state. All times are in ticks. The absolute deadline
+     * is the key of the `dl_node`
+     */
+    struct heap_node dl_node;
+    u64 dl_runtime;
+    u64 dl_period;
+    u64 dl_deadline;
+    u64 dl_period_start;
+    u64 dl_budget;
+    u32 dl_util;
+
+    /*
+     * Application class state. The virtual runtime is the runtime in ticks
+     * scaled by APP_WEIGHT_DEFAULT over the weight of the thread
+     */
+    struct heap_node app_node;
+    u64 vruntime;
+    u32 weight;
+
+    /*
+     * Background class quota in ticks. A quota of zero is unlimited. The
+     * budget is the part of the quota left in the current period
+     */
+    u64 bg_quota;
+    u64 bg_period;
+    u64 bg_period_start;
+    u64 bg_budget;
+
+    /*
+     * CPU cycles spent running the thread, not counting exception handlers
+     * and context switches, and the number of times it has been switched in
+     */
+    u64 cycles;
+    u32 switch_count;
 
     /* Thread ID number */
     tid_t tid;
 
     /* Flag is set to one is an exit is pending */
     u8 exit_pending;
+    u32 exit_status;
 
     /* 
      * Code base address. If this field is zero no dynamic code 
@@ -106,24 +352,60 @@ struct thread {
     u32* code_addr;
 };
 
+/*
+ * CPU time accounting measured with the DWT cycle counter. The current
+ * thread is charged at every PendSV context switch. Time spent in the
+ * SysTick handler, and in handlers using `scheduler_isr_enter` and
+ * `scheduler_isr_exit`, is charged to `isr_cycles` instead of the thread
+ */
+struct cpu_stats {
+    /* Total cycles since the scheduler started */
+    u64 cycles;
+    u64 isr_cycles;
+
+    /* Cycles spent in the PendSV handler */
+    u64 switch_cycles;
+    u32 switch_count;
+
+    /* Longest SysTick handler since the last `scheduler_reset_isr_max` */
+    u32 systick_max_cycles;
+};
+
+/*
+ * Snapshot of the accounting of a single thread
+ */
+struct thread_stats {
+    char name[THREAD_MAX_NAME_LEN];
+    enum sched_class class;
+    u64 cycles;
+    u32 switch_count;
+};
+
 /*
  * Each scheduling class will have its own set of functions defined
  * in this struct. 
  */
 struct scheduling_class {
-    /* Link to the next scheduling class */
-    const struct scheduling_class* next;
+    /* Number of the scheduling class. See SCHED_CLASS_RANK */
+    enum sched_class id;
 
     struct thread* (*pick_thread)(struct rq* rq);
     void           (*enqueue)(struct thread* thread, struct rq* rq);
     void           (*dequeue)(struct thread* thread, struct rq* rq);
     void           (*unblock)(struct thread* thread, struct rq* rq);
     void           (*block)(struct thread* thread, struct rq* rq);
+
+    /*
+     * Optional hook called from the SysTick exception after the current
+     * thread has run for `runtime` ticks
+     */
+    void           (*tick)(struct thread* thread, struct rq* rq, u64 runtime);
 };
 
 /*
  * These are the different scheduling classes in the kernel
  */
+extern const struct scheduling_class deadline_class;
 extern const struct scheduling_class rt_class;
 extern const struct scheduling_class app_class;
 extern const struct scheduling_class background_class;
@@ -134,8 +416,12 @@ extern const struct scheduling_class idle_class;
  */
 void scheduler_start(void);
 
+struct thread* core_scheduler(struct rq* rq);
+
 void scheduler_enqueue_delay(struct thread* thread);
 
+void scheduler_dequeue_delay(struct thread* thread);
+
 void reschedule(void);
 
 void suspend_scheduler(void);
@@ -146,10 +432,29 @@ u64 get_kernel_tick(void);
 
 struct thread* get_thread(struct rq *rq, tid_t tid);
 
-u64 get_idle_runtime(void);
+void scheduler_isr_enter(void);
+
+void scheduler_isr_exit(void);
+
+void scheduler_get_cpu_stats(struct cpu_stats* stats);
+
+void scheduler_reset_isr_max(void);
+
+u8 scheduler_get_thread_stats(tid_t tid, struct thread_stats* stats);
 
 void scheduler_unblock_thread(struct thread* thread);
 
+void scheduler_unblock_thread_isr(struct thread* thread);
+
 void scheduler_block_thread(struct thread* thread);
 
+void scheduler_block_thread_timeout(struct thread* thread, u64 timeout);
+
+void scheduler_kill_thread(struct thread* thread, u32 status);
+
+void scheduler_set_priority(struct thread* thread,
+    const struct scheduling_class* class, u8 priority);
+
+const struct scheduling_class* scheduler_get_class(enum sched_class class);
+
 #endif
\ No newline at end of file
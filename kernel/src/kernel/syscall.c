@@ -1,54 +1,549 @@
 /* Copyright (C) StrawberryHacker */
 
 #include "syscall.h"
-#include "print.h"
+#include "syscall_abi.h"
+#include "scheduler.h"
 #include "thread.h"
+#include "mutex.h"
+#include "msg_queue.h"
+#include "timer.h"
+#include "fat32.h"
+#include "memory.h"
+#include "trace.h"
 #include "gpio.h"
 #include "panic.h"
 #include "print.h"
+#include "config.h"
+
+#include <stddef.h>
 
 /*
- * Syscall arguments will automaticall be placed in the registers
- * R0-R3 so the svc instructions can be called right away
+ * Kernel stubs using the system call ABI. The arguments are allready in
+ * R0-R3. A syscall run in thread mode returns through LR, so LR is saved
+ * around the SVC
  */
+#define SYSCALL_STUB(nr)                  \
+    asm volatile ("push {r4, lr}  \n\t"   \
+                  "mov r12, #" #nr " \n\t" \
+                  "svc #0         \n\t"   \
+                  "pop {r4, pc}")
+
 void NAKED NOINLINE syscall_thread_sleep(u32 ms) {
-    asm volatile ("svc #1 \n\t");
-    asm volatile ("bx lr");
+    SYSCALL_STUB(1);
 }
 
 void NAKED NOINLINE syscall_gpio_toggle(gpio_reg* port, u8 pin) {
-    asm volatile ("svc #2 \n\t");
-    asm volatile ("bx lr");
+    SYSCALL_STUB(2);
 }
 
 void* NAKED NOINLINE syscall_mm_alloc(u32 size, enum physmem_e region) {
-    asm volatile("svc #3 \n\t");
-    asm volatile ("bx lr");
+    SYSCALL_STUB(3);
 }
 
 void NAKED NOINLINE syscall_mm_free(void* ptr) {
-    asm volatile ("svc #4 \n\t");
-    asm volatile ("bx lr");
+    SYSCALL_STUB(4);
 }
 
 void NAKED NOINLINE syscall_print_byte(u8 data) {
-    asm volatile ("svc #5 \n\t");
-    asm volatile ("bx lr");
+    SYSCALL_STUB(5);
 }
 
 u8 NAKED NOINLINE syscall_print_get_status(void) {
-    asm volatile ("svc #6 \n\t");
-    asm volatile ("bx lr");
+    SYSCALL_STUB(6);
 }
 
 u32 NAKED NOINLINE syscall_read_print(char* data, u32 size) {
-    asm volatile ("svc #7 \n\t");
-    asm volatile ("bx lr");
+    SYSCALL_STUB(7);
+}
+
+extern struct thread* curr_thread;
+
+/*
+ * Kernel objects handed out to applications are reached through a kernel
+ * owned handle table. The handle given to the application is a pointer
+ * into the table, so a bad handle is caught by a range check before
+ * anything is read through it. The handle also records the thread which
+ * made the object, so the object is released when the thread exits
+ */
+#define SYS_MUTEX_MAGIC 0x4D555458
+#define SYS_QUEUE_MAGIC 0x51554555
+#define SYS_TIMER_MAGIC 0x54494D45
+#define SYS_FILE_MAGIC  0x46494C45
+
+struct sys_handle {
+    /* Type of the object. Zero if the handle is free */
+    u32 magic;
+
+    /* Thread which made the object. NULL if the thread has exited */
+    struct thread* owner;
+
+    void* object;
+};
+
+static struct sys_handle sys_handles[SYS_HANDLE_COUNT];
+
+/* The file system is not reentrant */
+static struct mutex sys_file_lock = {
+    .held_node = { .obj = &sys_file_lock }
+};
+
+/*
+ * Allocates a kernel object for an application and a handle to it. The
+ * allocator is not reentrant, so the scheduler is suspended like in the
+ * reaper. Returns NULL if there is no free handle or no memory
+ */
+static struct sys_handle* sys_handle_new(u32 size, u32 magic) {
+    struct sys_handle* handle = NULL;
+
+    suspend_scheduler();
+    for (u32 i = 0; i < SYS_HANDLE_COUNT; i++) {
+        if (sys_handles[i].magic == 0) {
+            handle = &sys_handles[i];
+            break;
+        }
+    }
+    if (handle) {
+        handle->object = mm_alloc(size, SRAM);
+        if (handle->object) {
+            handle->magic = magic;
+            handle->owner = curr_thread;
+        } else {
+            handle = NULL;
+        }
+    }
+    resume_scheduler();
+
+    return handle;
+}
+
+static void sys_handle_free(struct sys_handle* handle) {
+    suspend_scheduler();
+    mm_free(handle->object);
+    handle->object = NULL;
+    handle->owner = NULL;
+    handle->magic = 0;
+    resume_scheduler();
+}
+
+/*
+ * Returns the object of a handle given by an application, or NULL if the
+ * handle is not in the table or is not of the right type
+ */
+static void* sys_handle_get(struct sys_handle* handle, u32 magic) {
+    u32 offset = (u32)handle - (u32)sys_handles;
+
+    if ((offset >= sizeof(sys_handles)) ||
+        (offset % sizeof(struct sys_handle))) {
+        return NULL;
+    }
+    return (handle->magic == magic) ? handle->object : NULL;
+}
+
+static u32 sys_abi_version(void) {
+    return SYSCALL_ABI_VERSION;
+}
+
+static u32 sys_thread_sleep(u32 ms) {
+    thread_sleep((u64)ms);
+    return 0;
+}
+
+static u32 sys_gpio_toggle(gpio_reg* port, u32 pin) {
+    gpio_toggle(port, (u8)pin);
+    return 0;
+}
+
+static void* sys_mm_alloc(u32 size, u32 region) {
+    if (region > DRAM_BANK_4) {
+        return NULL;
+    }
+    suspend_scheduler();
+    void* ptr = mm_alloc(size, (enum physmem_e)region);
+    resume_scheduler();
+
+    return ptr;
+}
+
+static u32 sys_mm_free(void* ptr) {
+    suspend_scheduler();
+    mm_free(ptr);
+    resume_scheduler();
+
+    return 0;
+}
+
+/*
+ * Copies at most `size` bytes of the `mm_stats` of a physical memory.
+ * Returns the number of bytes copied
+ */
+static u32 sys_mm_stats(u32 region, void* stats, u32 size) {
+    if ((region > DRAM_BANK_4) || (stats == NULL)) {
+        return SYSCALL_ERROR;
+    }
+    struct mm_stats mm_stats;
+
+    suspend_scheduler();
+    mm_get_stats((enum physmem_e)region, &mm_stats);
+    resume_scheduler();
+
+    if (size > sizeof(struct mm_stats)) {
+        size = sizeof(struct mm_stats);
+    }
+    memory_copy(&mm_stats, stats, size);
+
+    return size;
+}
+
+static u32 sys_print_byte(u32 data) {
+    print_byte((u8)data);
+    return 0;
+}
+
+static u32 sys_print_get_status(void) {
+    return print_get_status();
+}
+
+static u32 sys_read_print(char* data, u32 size) {
+    return read_print_buffer(data, size);
+}
+
+static u32 sys_thread_yield(void) {
+    reschedule();
+    return 0;
+}
+
+static void* sys_mutex_new(void) {
+    struct sys_handle* handle = sys_handle_new(sizeof(struct mutex),
+        SYS_MUTEX_MAGIC);
+    if (handle) {
+        mutex_init((struct mutex *)handle->object);
+    }
+    return handle;
+}
+
+static u32 sys_mutex_delete(struct sys_handle* handle) {
+    struct mutex* mutex = sys_handle_get(handle, SYS_MUTEX_MAGIC);
+    if ((mutex == NULL) || mutex->owner) {
+        return SYSCALL_ERROR;
+    }
+    sys_handle_free(handle);
+    return 0;
+}
+
+static u32 sys_mutex_lock(struct sys_handle* handle) {
+    struct mutex* mutex = sys_handle_get(handle, SYS_MUTEX_MAGIC);
+    if ((mutex == NULL) || (mutex->owner == curr_thread)) {
+        return SYSCALL_ERROR;
+    }
+    mutex_lock(mutex);
+    return 0;
+}
+
+/*
+ * Returns 1 if the mutex was locked and 0 if it is taken
+ */
+static u32 sys_mutex_try_lock(struct sys_handle* handle) {
+    struct mutex* mutex = sys_handle_get(handle, SYS_MUTEX_MAGIC);
+    if (mutex == NULL) {
+        return SYSCALL_ERROR;
+    }
+    return mutex_try_lock(mutex);
+}
+
+static u32 sys_mutex_unlock(struct sys_handle* handle) {
+    struct mutex* mutex = sys_handle_get(handle, SYS_MUTEX_MAGIC);
+    if ((mutex == NULL) || (mutex->owner != curr_thread)) {
+        return SYSCALL_ERROR;
+    }
+    mutex_unlock(mutex);
+    return 0;
+}
+
+static void* sys_queue_new(u32 capacity, u32 msg_size, u32 msg_count) {
+    struct sys_handle* handle = sys_handle_new(sizeof(struct msg_queue),
+        SYS_QUEUE_MAGIC);
+    if (handle == NULL) {
+        return NULL;
+    }
+
+    suspend_scheduler();
+    u8 status = msg_queue_new((struct msg_queue *)handle->object, capacity,
+        msg_size, msg_count);
+    resume_scheduler();
+
+    if (!status) {
+        sys_handle_free(handle);
+        return NULL;
+    }
+    return handle;
+}
+
+static u32 sys_queue_delete(struct sys_handle* handle) {
+    struct msg_queue* queue = sys_handle_get(handle, SYS_QUEUE_MAGIC);
+    if ((queue == NULL) || queue->send_q.size || queue->recv_q.size) {
+        return SYSCALL_ERROR;
+    }
+    suspend_scheduler();
+    msg_queue_delete(queue);
+    resume_scheduler();
+
+    sys_handle_free(handle);
+    return 0;
+}
+
+static void* sys_msg_alloc(struct sys_handle* handle) {
+    struct msg_queue* queue = sys_handle_get(handle, SYS_QUEUE_MAGIC);
+    if ((queue == NULL) || (queue->msg_count == 0)) {
+        return NULL;
+    }
+    return msg_alloc(queue);
+}
+
+static u32 sys_msg_free(struct sys_handle* handle, void* msg) {
+    struct msg_queue* queue = sys_handle_get(handle, SYS_QUEUE_MAGIC);
+    if ((queue == NULL) || (queue->msg_count == 0)) {
+        return SYSCALL_ERROR;
+    }
+    msg_free(queue, msg);
+    return 0;
+}
+
+/*
+ * Returns 1 if the message was sent and 0 on timeout
+ */
+static u32 sys_msg_send(struct sys_handle* handle, void* msg, u32 timeout) {
+    struct msg_queue* queue = sys_handle_get(handle, SYS_QUEUE_MAGIC);
+    if (queue == NULL) {
+        return SYSCALL_ERROR;
+    }
+    return msg_send(queue, msg, timeout);
+}
+
+static void* sys_msg_receive(struct sys_handle* handle, u32 timeout) {
+    struct msg_queue* queue = sys_handle_get(handle, SYS_QUEUE_MAGIC);
+    if (queue == NULL) {
+        return NULL;
+    }
+    return msg_receive(queue, timeout);
+}
+
+/*
+ * The callback runs in the timer service thread
+ */
+static void* sys_timer_new(void (*func)(void*), void* arg) {
+    if (func == NULL) {
+        return NULL;
+    }
+    struct sys_handle* handle = sys_handle_new(sizeof(struct timer),
+        SYS_TIMER_MAGIC);
+    if (handle) {
+        timer_init((struct timer *)handle->object, func, arg);
+    }
+    return handle;
+}
+
+static u32 sys_timer_delete(struct sys_handle* handle) {
+    struct timer* timer = sys_handle_get(handle, SYS_TIMER_MAGIC);
+    if (timer == NULL) {
+        return SYSCALL_ERROR;
+    }
+    timer_stop(timer);
+    sys_handle_free(handle);
+    return 0;
+}
+
+static u32 sys_timer_start(struct sys_handle* handle, u32 delay, u32 period) {
+    struct timer* timer = sys_handle_get(handle, SYS_TIMER_MAGIC);
+    if (timer == NULL) {
+        return SYSCALL_ERROR;
+    }
+    return timer_try_start(timer, delay, period) ? 0 : SYSCALL_ERROR;
+}
+
+static u32 sys_timer_stop(struct sys_handle* handle) {
+    struct timer* timer = sys_handle_get(handle, SYS_TIMER_MAGIC);
+    if (timer == NULL) {
+        return SYSCALL_ERROR;
+    }
+    timer_stop(timer);
+    return 0;
+}
+
+static void* sys_file_open(const char* path) {
+    if (path == NULL) {
+        return NULL;
+    }
+    struct sys_handle* handle = sys_handle_new(sizeof(struct file),
+        SYS_FILE_MAGIC);
+    if (handle == NULL) {
+        return NULL;
+    }
+
+    mutex_lock(&sys_file_lock);
+    fstatus status = fat_file_open((struct file *)handle->object, path,
+        string_len(path));
+    mutex_unlock(&sys_file_lock);
+
+    if (status != FSTATUS_OK) {
+        sys_handle_free(handle);
+        return NULL;
+    }
+    return handle;
+}
+
+static u32 sys_file_close(struct sys_handle* handle) {
+    struct file* file = sys_handle_get(handle, SYS_FILE_MAGIC);
+    if (file == NULL) {
+        return SYSCALL_ERROR;
+    }
+    mutex_lock(&sys_file_lock);
+    fstatus status = fat_file_close(file);
+    mutex_unlock(&sys_file_lock);
+
+    sys_handle_free(handle);
+    return (status == FSTATUS_OK) ? 0 : SYSCALL_ERROR;
+}
+
+/*
+ * Returns the number of bytes read. This is less than `size` at the end of
+ * the file
+ */
+static u32 sys_file_read(struct sys_handle* handle, u8* data, u32 size) {
+    struct file* file = sys_handle_get(handle, SYS_FILE_MAGIC);
+    if (file == NULL) {
+        return SYSCALL_ERROR;
+    }
+    u32 count = 0;
+
+    mutex_lock(&sys_file_lock);
+    fstatus status = fat_file_read(file, data, size, &count);
+    mutex_unlock(&sys_file_lock);
+
+    if ((status != FSTATUS_OK) && (status != FSTATUS_EOF)) {
+        return SYSCALL_ERROR;
+    }
+    return count;
+}
+
+/*
+ * Returns the number of bytes written
+ */
+static u32 sys_file_write(struct sys_handle* handle, const u8* data,
+    u32 size)
+{
+    struct file* file = sys_handle_get(handle, SYS_FILE_MAGIC);
+    if (file == NULL) {
+        return SYSCALL_ERROR;
+    }
+    mutex_lock(&sys_file_lock);
+    fstatus status = fat_file_write(file, data, size);
+    mutex_unlock(&sys_file_lock);
+
+    return (status == FSTATUS_OK) ? size : SYSCALL_ERROR;
+}
+
+static u32 sys_file_seek(struct sys_handle* handle, u32 offset) {
+    struct file* file = sys_handle_get(handle, SYS_FILE_MAGIC);
+    if (file == NULL) {
+        return SYSCALL_ERROR;
+    }
+    mutex_lock(&sys_file_lock);
+    fstatus status = fat_file_jump(file, offset);
+    mutex_unlock(&sys_file_lock);
+
+    return (status == FSTATUS_OK) ? 0 : SYSCALL_ERROR;
+}
+
+static u32 sys_file_size(struct sys_handle* handle) {
+    struct file* file = sys_handle_get(handle, SYS_FILE_MAGIC);
+    if (file == NULL) {
+        return SYSCALL_ERROR;
+    }
+    return file->size;
+}
+
+/*
+ * Copies the data into the console transmit ring. The thread is only
+ * blocked while the ring is full. Returns the number of bytes written
+ */
+static u32 sys_write(const char* data, u32 size) {
+    if ((data == NULL) && size) {
+        return SYSCALL_ERROR;
+    }
+    return print_write(data, size);
+}
+
+/*
+ * Releases the kernel objects made by a thread which has exited. Timers are
+ * stopped since their callbacks are in the code of the thread, and files
+ * are closed. A mutex or queue which another thread is still using is kept
+ * without an owner, and can be deleted by any thread. This is called by the
+ * reaper before the memory of the thread is freed
+ */
+void syscall_release_thread(struct thread* thread) {
+    for (u32 i = 0; i < SYS_HANDLE_COUNT; i++) {
+        struct sys_handle* handle = &sys_handles[i];
+        if ((handle->magic == 0) || (handle->owner != thread)) {
+            continue;
+        }
+
+        if (handle->magic == SYS_TIMER_MAGIC) {
+            timer_stop((struct timer *)handle->object);
+        } else if (handle->magic == SYS_MUTEX_MAGIC) {
+            struct mutex* mutex = (struct mutex *)handle->object;
+            if (mutex->owner || mutex->wait_q.size) {
+                handle->owner = NULL;
+                continue;
+            }
+        } else if (handle->magic == SYS_QUEUE_MAGIC) {
+            struct msg_queue* queue = (struct msg_queue *)handle->object;
+            if (queue->send_q.size || queue->recv_q.size) {
+                handle->owner = NULL;
+                continue;
+            }
+            suspend_scheduler();
+            msg_queue_delete(queue);
+            resume_scheduler();
+        } else if (handle->magic == SYS_FILE_MAGIC) {
+            mutex_lock(&sys_file_lock);
+            fat_file_close((struct file *)handle->object);
+            mutex_unlock(&sys_file_lock);
+        }
+        sys_handle_free(handle);
+    }
 }
 
 /*
- * Core SVC handler which does the unstacking of the SVC argument
- * and function parameters
+ * A system call is called with the four argument registers no matter how
+ * many it uses. This is fine with the AAPCS, so the functions are stored
+ * without a prototype
+ */
+typedef u32 (*syscall_fn)();
+
+enum syscall_mode {
+    SYSCALL_MODE_HANDLER,
+    SYSCALL_MODE_THREAD
+};
+
+struct syscall_entry {
+    syscall_fn func;
+    enum syscall_mode mode;
+};
+
+#define SYSCALL(nr, name, mode, ret, params) \
+    [nr] = { (syscall_fn)sys_##name, SYSCALL_MODE_##mode },
+
+static const struct syscall_entry syscall_table[] = {
+    SYSCALL_LIST
+};
+
+#undef SYSCALL
+
+#define SYSCALL_COUNT (sizeof(syscall_table) / sizeof(struct syscall_entry))
+
+/*
+ * Core SVC handler which does the unstacking of the system call number and
+ * the function parameters
  */
 void svc_handler_ext(u32* stack_ptr) {
     /*
@@ -57,47 +552,31 @@ void svc_handler_ext(u32* stack_ptr) {
      *
      *    0   1   2   3   4    5   6   7
      *    R0, R1, R2, R3, R12, LR, PC, xPSR
-     *                             ^
-     * Registers R0-R3 are used for parameter passing. The PC hold the
-     * next instruction before the SVC handler. Therefore the svc #n
-     * will be located at byte address PC - 2. Since the processor
-     * uses little endian, that address is two bytes back from the
-     * value pointed to by PC. Therefore svc argument is *PC - 2
+     *
+     * Registers R0-R3 are used for parameter passing and R12 holds the
+     * system call number. The return value is written back to R0. The
+     * stacked PC points right after the 16-bit SVC instruction, whose low
+     * byte is the immediate. Only `svc #0` is a system call
      */
-    u8 svc = *((u8 *)stack_ptr[6] - 2);
+    u32 nr = stack_ptr[4];
+    u8 imm = ((u16 *)stack_ptr[6])[-1] & 0xFF;
+    tid_t tid = curr_thread->tid;
+    trace(TRACE_SYSCALL_ENTRY, tid, nr);
 
-    switch (svc) {
-        case 1 : {
-            thread_sleep((u64)stack_ptr[0]);
-            break;
-        }
-        case 2 : {
-            gpio_toggle((gpio_reg *)stack_ptr[0], (u8)stack_ptr[1]);
-            break;
-        } 
-        case 3 : {
-            panic("Warning");
-            stack_ptr[0] = (u32)mm_alloc(stack_ptr[0], 
-                (enum physmem_e)stack_ptr[1]);
-            break;
-        }
-        case 4 : {
-            panic("Warning");
-            mm_free((void *)stack_ptr[0]);
-            break;
-        } 
-        case 5 : {
-            print_byte((u8)stack_ptr[0]);
-            break;
-        }
-        case 6 : {
-            stack_ptr[0] = (u8)print_get_status();
-            break;
-        }
-        case 7 : {
-            stack_ptr[0] = read_print_buffer((char *)stack_ptr[0], stack_ptr[1]);
-            break;
-        }
-        
+    if (imm || (nr >= SYSCALL_COUNT) || (syscall_table[nr].func == NULL)) {
+        stack_ptr[0] = SYSCALL_ERROR;
+    } else if (syscall_table[nr].mode == SYSCALL_MODE_HANDLER) {
+        stack_ptr[0] = syscall_table[nr].func(stack_ptr[0], stack_ptr[1],
+            stack_ptr[2], stack_ptr[3]);
+    } else {
+        /*
+         * The exception returns into the system call function instead of
+         * the caller, with the arguments still in R0-R3. The function
+         * returns to the instruction after the SVC. This way it runs in
+         * thread mode and can block like any other thread
+         */
+        stack_ptr[5] = stack_ptr[6] | 1;
+        stack_ptr[6] = (u32)syscall_table[nr].func & ~1;
     }
+    trace(TRACE_SYSCALL_EXIT, tid, nr);
 }
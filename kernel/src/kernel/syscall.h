@@ -10,6 +10,26 @@
 
 #define NAKED __attribute__((naked))
 
+/*
+ * Makes the system call `nr` from thread mode. See `syscall_abi.h`. A
+ * system call might run in thread mode and return through LR, so all
+ * registers the AAPCS allows a function to change are clobbered
+ */
+static inline u32 syscall_invoke(u32 nr, u32 a0, u32 a1, u32 a2, u32 a3) {
+    register u32 r0 asm("r0") = a0;
+    register u32 r1 asm("r1") = a1;
+    register u32 r2 asm("r2") = a2;
+    register u32 r3 asm("r3") = a3;
+    register u32 r12 asm("r12") = nr;
+
+    asm volatile ("svc #0"
+        : "+r" (r0), "+r" (r1), "+r" (r2), "+r" (r3), "+r" (r12)
+        :
+        : "lr", "cc", "memory",
+          "d0", "d1", "d2", "d3", "d4", "d5", "d6", "d7");
+    return r0;
+}
+
 void NAKED NOINLINE syscall_thread_sleep(u32 ms);
 
 void NAKED NOINLINE syscall_gpio_toggle(gpio_reg* port, u8 pin);
@@ -24,4 +44,10 @@ u8 NAKED NOINLINE syscall_print_get_status(void);
 
 u32 NAKED NOINLINE syscall_read_print(char* data, u32 size);
 
-#endif
\ No newline at end of file
+void svc_handler_ext(u32* stack_ptr);
+
+struct thread;
+
+void syscall_release_thread(struct thread* thread);
+
+#endif
@@ -0,0 +1,66 @@
+/* Copyright (C) StrawberryHacker */
+
+#ifndef SYSCALL_ABI_H
+#define SYSCALL_ABI_H
+
+/*
+ * System call ABI between the kernel and the applications. A system call is
+ * made with `svc #0` with the system call number in R12 and up to four
+ * arguments in R0-R3. The return value is placed in R0
+ *
+ * This list is the only definition of the system calls. The kernel builds
+ * its syscall table from it, and `tools/syscall_gen.py` generates the stub
+ * header for the applications from it. A number is never reused or
+ * changed. New system calls are added at the end, and the version is
+ * increased when the list changes
+ *
+ * SYSCALL(number, name, mode, return type, parameters)
+ *
+ * The mode is HANDLER for short calls which are run in the SVC handler, and
+ * THREAD for calls which might block or run for long. These are run in
+ * thread mode by the calling thread itself
+ */
+#define SYSCALL_ABI_VERSION 3
+
+#define SYSCALL_LIST \
+    SYSCALL(0,  abi_version,      HANDLER, u32,   (void)) \
+    SYSCALL(1,  thread_sleep,     HANDLER, void,  (u32 ms)) \
+    SYSCALL(2,  gpio_toggle,      HANDLER, void,  (void* port, u32 pin)) \
+    SYSCALL(3,  mm_alloc,         THREAD,  void*, (u32 size, u32 region)) \
+    SYSCALL(4,  mm_free,          THREAD,  void,  (void* ptr)) \
+    SYSCALL(5,  print_byte,       HANDLER, void,  (u32 data)) \
+    SYSCALL(6,  print_get_status, HANDLER, u32,   (void)) \
+    SYSCALL(7,  read_print,       HANDLER, u32,   (char* data, u32 size)) \
+    SYSCALL(8,  thread_yield,     HANDLER, void,  (void)) \
+    SYSCALL(9,  mutex_new,        THREAD,  void*, (void)) \
+    SYSCALL(10, mutex_delete,     THREAD,  u32,   (void* mutex)) \
+    SYSCALL(11, mutex_lock,       THREAD,  u32,   (void* mutex)) \
+    SYSCALL(12, mutex_try_lock,   HANDLER, u32,   (void* mutex)) \
+    SYSCALL(13, mutex_unlock,     HANDLER, u32,   (void* mutex)) \
+    SYSCALL(14, queue_new,        THREAD,  void*, (u32 capacity, u32 msg_size, u32 msg_count)) \
+    SYSCALL(15, queue_delete,     THREAD,  u32,   (void* queue)) \
+    SYSCALL(16, msg_alloc,        HANDLER, void*, (void* queue)) \
+    SYSCALL(17, msg_free,         HANDLER, u32,   (void* queue, void* msg)) \
+    SYSCALL(18, msg_send,         THREAD,  u32,   (void* queue, void* msg, u32 timeout)) \
+    SYSCALL(19, msg_receive,      THREAD,  void*, (void* queue, u32 timeout)) \
+    SYSCALL(20, timer_new,        THREAD,  void*, (void* func, void* arg)) \
+    SYSCALL(21, timer_delete,     THREAD,  u32,   (void* timer)) \
+    SYSCALL(22, timer_start,      HANDLER, u32,   (void* timer, u32 delay, u32 period)) \
+    SYSCALL(23, timer_stop,       HANDLER, u32,   (void* timer)) \
+    SYSCALL(24, file_open,        THREAD,  void*, (const char* path)) \
+    SYSCALL(25, file_close,       THREAD,  u32,   (void* file)) \
+    SYSCALL(26, file_read,        THREAD,  u32,   (void* file, void* data, u32 size)) \
+    SYSCALL(27, file_write,       THREAD,  u32,   (void* file, const void* data, u32 size)) \
+    SYSCALL(28, file_seek,        THREAD,  u32,   (void* file, u32 offset)) \
+    SYSCALL(29, file_size,        THREAD,  u32,   (void* file)) \
+    SYSCALL(30, write,            THREAD,  u32,   (const char* data, u32 size)) \
+    SYSCALL(31, mm_stats,         THREAD,  u32,   (u32 region, void* stats, u32 size))
+
+/* Returned by system calls returning a status or a count if they fail */
+#define SYSCALL_ERROR 0xFFFFFFFF
+
+/* Timeout values for `msg_send` and `msg_receive` in milliseconds */
+#define SYSCALL_NO_WAIT      0
+#define SYSCALL_WAIT_FOREVER 0xFFFFFFFF
+
+#endif
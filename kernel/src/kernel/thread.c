@@ -3,11 +3,16 @@
 #include "thread.h"
 #include "scheduler.h"
 #include "pmalloc.h"
+#include "slab.h"
+#include "mm.h"
 #include "print.h"
 #include "cpu.h"
 #include "panic.h"
 #include "memory.h"
 #include "cache.h"
+#include "deadline.h"
+#include "app.h"
+#include "background.h"
 
 #include <stddef.h>
 
@@ -16,6 +21,13 @@
  */
 extern struct rq cpu_rq;
 
+/*
+ * Thread control blocks are allocated from a slab cache, and the stacks are
+ * allocated from pmalloc
+ */
+static struct slab_cache thread_cache = SLAB_CACHE_INIT("thread",
+    sizeof(struct thread), THREAD_SLAB_OBJECTS, PMALLOC_BANK_3, NULL);
+
 /*
  * Holdes the current kernel tick times the systick reload value register
  */
@@ -54,15 +66,12 @@ u32* stack_setup(u32* stack_pointer, void(*thread)(void*), void* arg) {
 
     /*
      * The following registers will be manually stacked by the 
-     * stmdb instruction in the context switch. The link register
-     * has to stay on the top. The link register (or EXC_RETURN
-     * in an exception handler) holds the stacking status when 
-     * entering an exception handler
+     * stmdb instruction in the context switch. A new thread has no
+     * floating point context, so the exception stack frame above has
+     * the basic layout and S16-S31 are not stacked. This is given by
+     * the `exc_return` of the thread
      */
 
-    /* Setup the EXC_RETURN with no FPU and PSP usage*/
-    //*stack_pointer-- = 0xFFFFFFFD;
-
     /* Setup the rest of the processor registers */
     *stack_pointer-- = 0xCAFECAFE;          /* R11 */
     *stack_pointer-- = 0xCAFECAFE;          /* R10 */
@@ -78,30 +87,66 @@ u32* stack_setup(u32* stack_pointer, void(*thread)(void*), void* arg) {
 
 /*
  * Adds a new thread to the sceduler and enqueues is using its
- * designated scheduling class
+ * designated scheduling class. Returns zero if the thread table is
+ * full or if a deadline thread can not be admitted
  */
 tid_t new_thread(struct thread_info* thread_info) {
-    static tid_t tid = 1;
     suspend_scheduler();
 
-    /*
-     * Compute how many 1k pages are needed to store the stack and
-     * the thread control block
-     */
-    u32 size = sizeof(struct thread) + thread_info->stack_size * 4;
+    if (thread_table_is_full(&cpu_rq.thread_table)) {
+        resume_scheduler();
+        return 0;
+    }
+
+    /* Reserve the utilization of a deadline thread */
+    if (thread_info->class == DEADLINE) {
+        if (!deadline_admit(thread_info, &cpu_rq)) {
+            resume_scheduler();
+            return 0;
+        }
+    }
+
+    /* Compute how many pages are needed to store the stack */
+    u32 size = thread_info->stack_size * 4;
+#if STACK_GUARD
+    /* Room for aligning the guard region and the guard itself */
+    size += 2 * STACK_GUARD_SIZE;
+#endif
     u32 page_count = size / 512;
     if (size % 512) {
         page_count++;
     }
 	
-    /* Allocate the stack and thread control block */
-    struct thread* thread = (struct thread *)pmalloc(page_count, PMALLOC_BANK_3);
+    /* Allocate the thread control block and the stack */
+    struct thread* thread = (struct thread *)slab_alloc(&thread_cache);
+    u8* stack_start = (u8 *)pmalloc(page_count, PMALLOC_BANK_3);
+    thread->stack_mem = stack_start;
+
+    /*
+     * Calculate the stack base and the new stack pointer. The guard region
+     * has to be aligned to its own size and is placed below the stack
+     */
+#if STACK_GUARD
+    stack_start += (0 - (u32)stack_start) & (STACK_GUARD_SIZE - 1);
+    thread->stack_guard = (u32)stack_start;
+    stack_start += STACK_GUARD_SIZE;
+#else
+    thread->stack_guard = 0;
+#endif
+    thread->stack_base = (u32 *)stack_start;
+    thread->stack_size = thread_info->stack_size;
+
+    /* Paint the stack so the high-water mark can be found later */
+    for (u32 i = 0; i < thread->stack_size; i++) {
+        thread->stack_base[i] = THREAD_STACK_PAINT;
+    }
 
-    /* Calculate the stack base and the new stack pointer */
-    thread->stack_base = (u32 *)((u8 *)thread + sizeof(struct thread));
     thread->stack_pointer = thread->stack_base + thread_info->stack_size - 1;
 	thread->stack_pointer = stack_setup(thread->stack_pointer, 
         thread_info->thread, thread_info->arg);
+
+    /* Return to thread mode using the PSP without a floating point frame */
+    thread->exc_return = EXC_RETURN_THREAD_PSP;
 	
     /*
      * The threads list node must reference the thread object. Otherwise
@@ -110,20 +155,35 @@ tid_t new_thread(struct thread_info* thread_info) {
     thread->rq_node.obj = thread;
     thread->thread_node.obj = thread;
 
+    heap_node_init(&thread->sleep_node);
+    thread->sleep_node.obj = thread;
+    heap_node_init(&thread->dl_node);
+    thread->dl_node.obj = thread;
+    heap_node_init(&thread->app_node);
+    thread->app_node.obj = thread;
+
+    /* Only background threads might have a CPU quota */
+    thread->bg_quota = 0;
+
     /*
      * Each thread is assigned to a scheduling class, which can be
      * changed later. This is used for enqueuing the thread in a
      * running queue
      */
-    if (thread_info->class == REAL_TIME) {
+    if (thread_info->class == DEADLINE) {
+        thread->class = &deadline_class;
+        deadline_thread_init(thread, thread_info);
+    } else if (thread_info->class == REAL_TIME) {
         thread->class = &rt_class;
     } else if (thread_info->class == APPLICATION) {
         thread->class = &app_class;
     } else if (thread_info->class == BACKGROUND) {
         thread->class = &background_class;
+        background_thread_init(thread, thread_info);
     } else if (thread_info->class == IDLE) {
         thread->class = &idle_class;
     }
+    app_thread_init(thread, thread_info, &cpu_rq);
 
     /*
      * Initialize the `dlist` pointers. Accurding to specification
@@ -136,6 +196,24 @@ tid_t new_thread(struct thread_info* thread_info) {
 
     thread->rq_list = NULL;
 
+    /* Priority level inside the scheduling class */
+    thread->priority = thread_info->priority;
+    if (thread->priority >= PRIO_RQ_LEVELS) {
+        thread->priority = PRIO_RQ_LEVELS - 1;
+    }
+
+    /* Priority inheritance state */
+    thread->base_class = thread->class;
+    thread->base_priority = thread->priority;
+    thread->blocked_on = NULL;
+    dlist_init(&thread->mutexes);
+    dlist_node_init(&thread->wait_node);
+    thread->wait_node.obj = thread;
+    thread->wait_list = NULL;
+
+    thread->isr_wake_node.obj = thread;
+    thread->isr_wake_pending = 0;
+
     /* Assign a name to the thread */
     thread->name_len = string_len(thread_info->name);
     memory_copy(thread_info->name, thread->name, THREAD_MAX_NAME_LEN);
@@ -148,13 +226,14 @@ tid_t new_thread(struct thread_info* thread_info) {
 
     /* Initializing variables used for runtime stats */
     thread->tick_to_wake = 0;
-    thread->runtime_curr = 0;
-    thread->runtime_new = 0;
+    thread->cycles = 0;
+    thread->switch_count = 0;
 
     /* Assign a thread ID number */
-    thread->tid = tid++;
+    thread->tid = thread_table_alloc(&cpu_rq.thread_table, thread);
 
     thread->exit_pending = 0;
+    thread->exit_status = THREAD_EXIT_NORMAL;
 
     /* Update the code addr field */
     thread->code_addr = thread_info->code_addr;
@@ -172,6 +251,11 @@ tid_t new_thread(struct thread_info* thread_info) {
 }
 
 void thread_sleep(u64 ms) {
+    /* An exiting thread keeps running until the SysTick removes it */
+    if (curr_thread->exit_pending) {
+        return;
+    }
+
     /*
      * Calculate the tick to wake. The timebase will be the same as
      * the systick reload value register
@@ -187,13 +271,48 @@ void thread_sleep(u64 ms) {
 void thread_block(tid_t tid)
 {
     struct thread* th = get_thread(&cpu_rq, tid);
-    scheduler_block_thread(th);
+    if (th) {
+        scheduler_block_thread(th);
+    }
 }
 
 void thread_unblock(tid_t tid)
 {
     struct thread* th = get_thread(&cpu_rq, tid);
-    scheduler_unblock_thread(th);
+    if (th) {
+        scheduler_unblock_thread(th);
+    }
+}
+
+/*
+ * Returns the maximum number of stack words the thread has used since it
+ * was created. Returns 0 if the thread does not exist. The cost grows with
+ * the unused part of the stack only
+ */
+u32 thread_get_stack_high_water(tid_t tid) {
+    struct thread* th = get_thread(&cpu_rq, tid);
+    if (th == NULL) {
+        return 0;
+    }
+
+    u32 unused = 0;
+    while ((unused < th->stack_size) && 
+           (th->stack_base[unused] == THREAD_STACK_PAINT)) {
+        unused++;
+    }
+    return th->stack_size - unused;
+}
+
+/*
+ * Frees the memory of a thread which has exited. This uses pmalloc, so it
+ * can not be called from exception handlers
+ */
+void thread_free(struct thread* thread) {
+    if (thread->code_addr) {
+        mm_free(thread->code_addr);
+    }
+    pfree(thread->stack_mem);
+    slab_free(thread);
 }
 
 void kill_thread(tid_t tid) {
@@ -202,11 +321,24 @@ void kill_thread(tid_t tid) {
     struct thread* th = get_thread(&cpu_rq, tid);
 
     if (th) {
-        th->exit_pending = 1;
+        scheduler_kill_thread(th, THREAD_EXIT_KILLED);
         print("Killing %3s\n", th->name);
     } else {
-        print("Thread does not exist");
+        print("Thread does not exist or is allready exiting");
     }
 
     resume_scheduler();
 }
+
+/*
+ * Gets the exit status of a thread which has exited and been deleted.
+ * Returns 0 if the thread is still running or the status is no longer
+ * known
+ */
+u8 thread_get_exit_status(tid_t tid, u32* status) {
+    cpsid_i();
+    u8 found = thread_table_get_exit_status(&cpu_rq.thread_table, tid, status);
+    cpsie_i();
+
+    return found;
+}
@@ -10,6 +10,8 @@ tid_t new_thread(struct thread_info* thread_info);
 
 void thread_exit(void);
 
+void thread_free(struct thread* thread);
+
 void kill_thread(tid_t tid);
 
 void thread_sleep(u64 ms);
@@ -18,4 +20,8 @@ void thread_block(tid_t tid);
 
 void thread_unblock(tid_t tid);
 
+u32 thread_get_stack_high_water(tid_t tid);
+
+u8 thread_get_exit_status(tid_t tid, u32* status);
+
 #endif
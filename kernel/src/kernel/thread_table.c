@@ -0,0 +1,71 @@
+/* Copyright (C) StrawberryHacker */
+
+#include "thread_table.h"
+#include "cpu.h"
+#include "panic.h"
+
+/*
+ * Places `thread` in a free slot and returns its tid. The search starts
+ * after the word of the last allocated slot so freed slots are not reused
+ * right away. Panics if the table is full
+ */
+tid_t thread_table_alloc(struct thread_table* table, struct thread* thread) {
+    for (u32 i = 0; i < THREAD_TABLE_WORDS; i++) {
+        u32 word = (table->cursor + i) % THREAD_TABLE_WORDS;
+        u32 free = ~table->used[word];
+
+        /* Slot zero is reserved */
+        if (word == 0) {
+            free &= ~1;
+        }
+        if (free == 0) {
+            continue;
+        }
+
+        u32 bit = 31 - cpu_clz(free);
+        u32 index = word * 32 + bit;
+
+        table->used[word] |= (1 << bit);
+        table->thread[index] = thread;
+        table->cursor = word + 1;
+        table->count++;
+
+        return (table->generation[index] << THREAD_TABLE_BITS) | index;
+    }
+    panic("Thread table full");
+    return 0;
+}
+
+/*
+ * Frees the slot of `tid` and records the exit status of the thread. The
+ * generation is bumped so any copy of the tid becomes invalid
+ */
+void thread_table_free(struct thread_table* table, tid_t tid, u32 status) {
+    u32 index = tid & THREAD_TABLE_MASK;
+
+    if (thread_table_get(table, tid) == NULL) {
+        panic("Thread not in table");
+    }
+
+    table->used[index / 32] &= ~(1 << (index % 32));
+    table->thread[index] = NULL;
+    table->exit_status[index] = status;
+    table->generation[index]++;
+    table->count--;
+}
+
+/*
+ * Gets the exit status of a thread which has exited. The status is kept
+ * until the slot is freed again by the next thread using it. Returns 0 if
+ * the status is not known
+ */
+u8 thread_table_get_exit_status(struct thread_table* table, tid_t tid,
+    u32* status) {
+
+    u32 index = tid & THREAD_TABLE_MASK;
+    if (table->generation[index] != (tid >> THREAD_TABLE_BITS) + 1) {
+        return 0;
+    }
+    *status = table->exit_status[index];
+    return 1;
+}
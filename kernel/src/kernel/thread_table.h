@@ -0,0 +1,68 @@
+/* Copyright (C) StrawberryHacker */
+
+#ifndef THREAD_TABLE_H
+#define THREAD_TABLE_H
+
+#include "types.h"
+
+#include <stddef.h>
+
+/*
+ * A tid holds a slot index in the lower THREAD_TABLE_BITS and the
+ * generation of that slot in the upper bits. The generation is incremented
+ * every time a slot is freed, so a stale tid of an exited thread never
+ * matches the thread reusing its slot. Slot zero is never used which makes
+ * zero an invalid tid
+ */
+typedef uint32_t tid_t;
+
+#define THREAD_TABLE_BITS  8
+#define THREAD_TABLE_SIZE  (1 << THREAD_TABLE_BITS)
+#define THREAD_TABLE_MASK  (THREAD_TABLE_SIZE - 1)
+#define THREAD_TABLE_WORDS (THREAD_TABLE_SIZE / 32)
+
+struct thread;
+
+/*
+ * Table of all threads indexed by tid. A zero initialized table is empty
+ */
+struct thread_table {
+    struct thread* thread[THREAD_TABLE_SIZE];
+    u32 generation[THREAD_TABLE_SIZE];
+
+    /* Exit status of the last thread which used the slot */
+    u32 exit_status[THREAD_TABLE_SIZE];
+
+    /* Bitmap of the slots in use */
+    u32 used[THREAD_TABLE_WORDS];
+
+    /* Word to start the next free slot search from */
+    u32 cursor;
+    u32 count;
+};
+
+tid_t thread_table_alloc(struct thread_table* table, struct thread* thread);
+
+void thread_table_free(struct thread_table* table, tid_t tid, u32 status);
+
+u8 thread_table_get_exit_status(struct thread_table* table, tid_t tid,
+    u32* status);
+
+/*
+ * Returns the thread with the given tid or NULL if it does not exist
+ */
+static inline struct thread* thread_table_get(struct thread_table* table,
+    tid_t tid) {
+
+    u32 index = tid & THREAD_TABLE_MASK;
+    if (table->generation[index] != (tid >> THREAD_TABLE_BITS)) {
+        return NULL;
+    }
+    return table->thread[index];
+}
+
+static inline u8 thread_table_is_full(struct thread_table* table) {
+    return (table->count == THREAD_TABLE_SIZE - 1) ? 1 : 0;
+}
+
+#endif
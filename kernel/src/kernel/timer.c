@@ -0,0 +1,145 @@
+/* Copyright (C) StrawberryHacker */
+
+#include "timer.h"
+#include "scheduler.h"
+#include "thread.h"
+#include "cpu.h"
+#include "panic.h"
+
+#include <stddef.h>
+
+/*
+ * Defined in scheduler.c
+ */
+extern struct thread* curr_thread;
+extern struct rq cpu_rq;
+
+/* Active timers ordered by their tick to expire */
+static struct heap_node* timer_q_nodes[TIMER_Q_SIZE];
+static struct heap timer_q = {
+    .nodes    = timer_q_nodes,
+    .capacity = TIMER_Q_SIZE
+};
+
+static struct thread* timer_thread;
+
+/*
+ * The service thread runs the expired timers and then waits in the sleep
+ * queue until the first timer expires. It is unblocked early if a timer is
+ * started which expires before that
+ */
+static void timer_service(void* arg) {
+    timer_thread = curr_thread;
+
+    while (1) {
+        cpsid_i();
+        struct heap_node* first = heap_get_first(&timer_q);
+        u64 now = get_kernel_tick();
+
+        if (first && (first->key <= now)) {
+            heap_remove_first(&timer_q);
+            struct timer* timer = (struct timer *)first->obj;
+
+            /*
+             * A periodic timer keeps its phase. Periods which have been
+             * missed completely are skipped instead of run back to back
+             */
+            if (timer->period) {
+                first->key += timer->period;
+                if (first->key <= now) {
+                    first->key = now + timer->period;
+                }
+                heap_insert(first, &timer_q);
+            }
+            cpsie_i();
+
+            timer->func(timer->arg);
+            continue;
+        }
+
+        if (first) {
+            scheduler_block_thread_timeout(curr_thread, first->key - now);
+        } else {
+            scheduler_block_thread(curr_thread);
+        }
+        cpsie_i();
+    }
+}
+
+/*
+ * Starts the timer service thread
+ */
+void timer_service_init(void) {
+    struct thread_info info = {
+        .name       = "Timer",
+        .stack_size = TIMER_SERVICE_STACK_SIZE,
+        .thread     = timer_service,
+        .class      = REAL_TIME,
+        .priority   = TIMER_SERVICE_PRIORITY
+    };
+
+    tid_t tid = new_thread(&info);
+    if (tid == 0) {
+        panic("Timer service failed");
+    }
+    timer_thread = get_thread(&cpu_rq, tid);
+}
+
+void timer_init(struct timer* timer, void (*func)(void*), void* arg) {
+    heap_node_init(&timer->node);
+    timer->node.obj = timer;
+    timer->period = 0;
+    timer->func = func;
+    timer->arg = arg;
+}
+
+/*
+ * Starts or restarts a timer. The callback runs after `delay` milliseconds,
+ * and then every `period` milliseconds unless the period is zero. This can
+ * be called from exception handlers. Returns 0 if the timer queue is full
+ */
+u8 timer_try_start(struct timer* timer, u32 delay, u32 period) {
+    cpsid_i();
+    if (heap_node_is_queued(&timer->node)) {
+        heap_remove(&timer->node, &timer_q);
+    }
+    if (timer_q.size >= TIMER_Q_SIZE) {
+        cpsie_i();
+        return 0;
+    }
+
+    timer->period = (u64)period * SYSTICK_RVR;
+    timer->node.key = get_kernel_tick() + (u64)delay * SYSTICK_RVR;
+    heap_insert(&timer->node, &timer_q);
+
+    /* The service thread waits for an earlier timer unless this is first */
+    if ((heap_get_first(&timer_q) == &timer->node) && timer_thread) {
+        scheduler_unblock_thread_isr(timer_thread);
+    }
+    cpsie_i();
+    return 1;
+}
+
+/*
+ * Starts or restarts a timer. Panics if the timer queue is full
+ */
+void timer_start(struct timer* timer, u32 delay, u32 period) {
+    if (!timer_try_start(timer, delay, period)) {
+        panic("Timer queue full");
+    }
+}
+
+/*
+ * Stops a timer. A callback which is allready running is not affected
+ */
+void timer_stop(struct timer* timer) {
+    cpsid_i();
+    if (heap_node_is_queued(&timer->node)) {
+        heap_remove(&timer->node, &timer_q);
+    }
+    cpsie_i();
+}
+
+u8 timer_is_active(struct timer* timer) {
+    return heap_node_is_queued(&timer->node);
+}
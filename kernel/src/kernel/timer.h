@@ -0,0 +1,45 @@
+/* Copyright (C) StrawberryHacker */
+
+#ifndef TIMER_H
+#define TIMER_H
+
+#include "types.h"
+#include "heap.h"
+
+/* Maximum number of active timers */
+#define TIMER_Q_SIZE 64
+
+/* Real-time priority and stack size in words of the timer service thread */
+#define TIMER_SERVICE_PRIORITY 6
+#define TIMER_SERVICE_STACK_SIZE 256
+
+/*
+ * One-shot or periodic software timer. All timer callbacks run one at a
+ * time in the timer service thread, so they must not block for long. Many
+ * periodic tasks can share the service thread instead of each having a
+ * thread and a stack of its own. Timers use the kernel tick as timebase
+ */
+struct timer {
+    /* Node in the timer queue. The key is the tick to expire on */
+    struct heap_node node;
+
+    /* Period in ticks. A one-shot timer has a period of zero */
+    u64 period;
+
+    void (*func)(void* arg);
+    void* arg;
+};
+
+void timer_service_init(void);
+
+void timer_init(struct timer* timer, void (*func)(void*), void* arg);
+
+u8 timer_try_start(struct timer* timer, u32 delay, u32 period);
+
+void timer_start(struct timer* timer, u32 delay, u32 period);
+
+void timer_stop(struct timer* timer);
+
+u8 timer_is_active(struct timer* timer);
+
+#endif
@@ -0,0 +1,45 @@
+/* Copyright (C) StrawberryHacker */
+
+#include "trace.h"
+#include "print.h"
+
+#if TRACE_ENABLE
+
+/*
+ * The buffer can be read out with a debugger, for example with the GDB
+ * command `dump binary value trace.bin trace_buffer`, or printed over the
+ * serial port with `trace_dump`. Both can be converted into a Chrome trace
+ * with tools/trace_convert.py
+ */
+struct trace_buffer trace_buffer = {
+    .magic    = TRACE_MAGIC,
+    .size     = TRACE_BUFFER_SIZE,
+    .cpu_freq = 300000000,
+    .head     = 0
+};
+
+/*
+ * Prints the buffer as hex words. The first line holds the header, and the
+ * following lines hold one record each starting with the oldest record
+ */
+void trace_dump(void) {
+    u32 head = trace_buffer.head;
+    u32 start = 0;
+
+    if (head > TRACE_BUFFER_SIZE) {
+        start = head - TRACE_BUFFER_SIZE;
+    }
+
+    print("trace %4h %4h %4h %4h\n", trace_buffer.magic, trace_buffer.size,
+        trace_buffer.cpu_freq, head - start);
+
+    for (u32 i = start; i != head; i++) {
+        struct trace_record* record = &trace_buffer.record[i & 
+            TRACE_BUFFER_MASK];
+        print("%4h %4h %4h %4h\n", record->timestamp, record->event,
+            record->tid, record->arg);
+    }
+    print_flush();
+}
+
+#endif
@@ -0,0 +1,105 @@
+/* Copyright (C) StrawberryHacker */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "types.h"
+#include "exclusive.h"
+#include "dwt.h"
+
+/*
+ * Scheduler event tracing. Set to 1 to record events into `trace_buffer`.
+ * When disabled every trace call compiles to nothing
+ */
+#ifndef TRACE_ENABLE
+#define TRACE_ENABLE 0
+#endif
+
+/* Number of records in the ring buffer. Must be a power of two */
+#define TRACE_BUFFER_SIZE 1024
+#define TRACE_BUFFER_MASK (TRACE_BUFFER_SIZE - 1)
+
+/* Marks the start of the buffer in a memory dump. Reads "TRCE" */
+#define TRACE_MAGIC 0x45435254
+
+/*
+ * The meaning of the `tid` and `arg` fields of each event:
+ *
+ * TRACE_SWITCH        - previous thread, next thread
+ * TRACE_BLOCK         - blocked thread, 0
+ * TRACE_UNBLOCK       - unblocked thread, 0
+ * TRACE_SLEEP         - sleeping thread, sleep time in cycles
+ * TRACE_WAKE          - woken thread, 0
+ * TRACE_SYSCALL_ENTRY - calling thread, SVC number
+ * TRACE_SYSCALL_EXIT  - calling thread, SVC number
+ *
+ * The previous thread of a switch is zero if it has just exited
+ */
+enum trace_event {
+    TRACE_SWITCH,
+    TRACE_BLOCK,
+    TRACE_UNBLOCK,
+    TRACE_SLEEP,
+    TRACE_WAKE,
+    TRACE_SYSCALL_ENTRY,
+    TRACE_SYSCALL_EXIT
+};
+
+/*
+ * Fixed size trace record. The timestamp is the DWT cycle counter
+ */
+struct trace_record {
+    u32 timestamp;
+    u32 event;
+    u32 tid;
+    u32 arg;
+};
+
+/*
+ * The buffer is overwritten from the start when it is full. `head` is the
+ * total number of records written, so the oldest record is found at
+ * `head` modulo the size if `head` is larger than the size
+ */
+struct trace_buffer {
+    u32 magic;
+    u32 size;
+    u32 cpu_freq;
+    volatile u32 head;
+    struct trace_record record[TRACE_BUFFER_SIZE];
+};
+
+#if TRACE_ENABLE
+
+extern struct trace_buffer trace_buffer;
+
+/*
+ * Records an event. The slot is reserved with LDREX/STREX so this can be
+ * called from both threads and exception handlers without disabling
+ * interrupts
+ */
+static inline void trace(enum trace_event event, u32 tid, u32 arg) {
+    u32 head;
+    do {
+        head = ldrex(&trace_buffer.head);
+    } while (strex(&trace_buffer.head, head + 1));
+
+    struct trace_record* record = &trace_buffer.record[head & 
+        TRACE_BUFFER_MASK];
+
+    record->timestamp = dwt_get_cycles();
+    record->event = event;
+    record->tid = tid;
+    record->arg = arg;
+}
+
+void trace_dump(void);
+
+#else
+
+static inline void trace(enum trace_event event, u32 tid, u32 arg) {}
+
+static inline void trace_dump(void) {}
+
+#endif
+
+#endif
@@ -0,0 +1,114 @@
+/* Copyright (C) StrawberryHacker */
+
+#include "workqueue.h"
+#include "thread.h"
+#include "exclusive.h"
+#include "memory.h"
+#include "cpu.h"
+#include "panic.h"
+
+#include <stddef.h>
+
+/*
+ * Defined in scheduler.c
+ */
+extern struct thread* curr_thread;
+extern struct rq cpu_rq;
+
+struct workqueue system_wq;
+
+/*
+ * Runs the queued work items. The worker blocks when the queue is empty
+ * and is unblocked by `queue_work`. The queue is checked with interrupts
+ * disabled so a work item queued right before the worker blocks is not
+ * lost
+ */
+static void workqueue_worker(void* arg) {
+    struct workqueue* wq = (struct workqueue *)arg;
+    wq->worker = curr_thread;
+
+    while (1) {
+        cpsid_i();
+        if (mpsc_is_empty(&wq->queue)) {
+            scheduler_block_thread(curr_thread);
+        }
+        cpsie_i();
+
+        struct mpsc_node* node = mpsc_take_all(&wq->queue);
+        while (node) {
+            struct mpsc_node* next = node->next;
+            struct work* work = (struct work *)node->obj;
+
+            /*
+             * Take the count after reading `next`. If the work item is
+             * queued again from now on it is pushed onto the queue
+             */
+            u32 count;
+            do {
+                count = ldrex(&work->count);
+            } while (strex(&work->count, 0));
+
+            if (work->flags & WORK_COALESCE) {
+                count = 1;
+            }
+            while (count--) {
+                work->func(work->arg);
+            }
+            node = next;
+        }
+    }
+}
+
+void work_init(struct work* work, void (*func)(void*), void* arg, u8 flags) {
+    work->func = func;
+    work->arg = arg;
+    work->flags = flags;
+    work->count = 0;
+    work->node.next = NULL;
+    work->node.obj = work;
+}
+
+/*
+ * Starts a workqueue with a real-time worker thread of the given priority
+ */
+void workqueue_init(struct workqueue* wq, const char* name, u8 priority) {
+    mpsc_init(&wq->queue);
+    wq->worker = NULL;
+
+    struct thread_info info = {
+        .stack_size = WORKQUEUE_STACK_SIZE,
+        .thread     = workqueue_worker,
+        .arg        = wq,
+        .class      = REAL_TIME,
+        .priority   = priority
+    };
+    string_copy(name, info.name);
+
+    wq->tid = new_thread(&info);
+    if (wq->tid == 0) {
+        panic("Workqueue worker failed");
+    }
+    wq->worker = get_thread(&cpu_rq, wq->tid);
+}
+
+/*
+ * Queues a work item. This is safe to call from threads and exception
+ * handlers of any priority. Returns 1 if the work item was not allready
+ * pending
+ */
+u8 queue_work(struct workqueue* wq, struct work* work) {
+    u32 count;
+    do {
+        count = ldrex(&work->count);
+    } while (strex(&work->count, count + 1));
+
+    if (count) {
+        return 0;
+    }
+
+    /* Only the first push after the queue is emptied wakes the worker */
+    if (mpsc_push(&work->node, &wq->queue) && wq->worker) {
+        scheduler_unblock_thread_isr(wq->worker);
+    }
+    return 1;
+}
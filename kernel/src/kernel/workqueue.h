@@ -0,0 +1,60 @@
+/* Copyright (C) StrawberryHacker */
+
+#ifndef WORKQUEUE_H
+#define WORKQUEUE_H
+
+#include "types.h"
+#include "mpsc.h"
+#include "scheduler.h"
+
+/* Stack size of a worker thread in words */
+#define WORKQUEUE_STACK_SIZE 256
+
+/* Real-time priority of the system workqueue */
+#define SYSTEM_WQ_PRIORITY 4
+
+/*
+ * If set, queueing a work item which is allready pending has no effect, so
+ * the function runs once no matter how many times it was queued. Otherwise
+ * the function runs once for each time the work item was queued
+ */
+#define WORK_COALESCE 0x01
+
+/*
+ * Deferred work item. An exception handler queues the work item and returns,
+ * and the function is called later by the worker thread of the workqueue
+ */
+struct work {
+    void (*func)(void* arg);
+    void* arg;
+
+    u8 flags;
+
+    /* Number of times the work item has been queued but not run */
+    volatile u32 count;
+
+    struct mpsc_node node;
+};
+
+/*
+ * A workqueue has one real-time worker thread running the queued work
+ * items in FIFO order. Separate workqueues are used for work of different
+ * priorities
+ */
+struct workqueue {
+    struct mpsc queue;
+
+    struct thread* worker;
+    tid_t tid;
+};
+
+/* Workqueue for deferred work without special requirements */
+extern struct workqueue system_wq;
+
+void work_init(struct work* work, void (*func)(void*), void* arg, u8 flags);
+
+void workqueue_init(struct workqueue* wq, const char* name, u8 priority);
+
+u8 queue_work(struct workqueue* wq, struct work* work);
+
+#endif
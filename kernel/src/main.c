@@ -9,33 +9,33 @@
 #include "fpi.h"
 #include "usb_hid.h"
 #include "button.h"
+#include "timer.h"
 #include <stddef.h>
 
-static void print_thread(void* args)
+/*
+ * The periodic print runs in the timer service thread, so it does not need
+ * a thread and a stack of its own
+ */
+static struct timer print_timer;
+
+static void print_hello(void* arg)
 {
-	while (1) {
-		printl("Hello");
-		syscall_thread_sleep(500);
-	}
+	printl("Hello");
 }
 
-static tid_t tid;
-
-static void thread_block_test(void)
+static void print_timer_toggle(void)
 {
-	static u8 block = 0;
-	if (block == 0) {
-		block = 1;
-		thread_block(tid);
+	if (timer_is_active(&print_timer)) {
+		timer_stop(&print_timer);
+		printl("Print timer stopped");
 	} else {
-		thread_unblock(tid);
-		block = 0;
+		timer_start(&print_timer, 500, 500);
+		printl("Print timer armed with a 500 ms period");
 	}
-	printl("Blocking");
 }
 
-struct button_callback thread_block_cb = {
-	.callback = &thread_block_test,
+struct button_callback print_toggle_cb = {
+	.callback = &print_timer_toggle,
 	.event = BUTTON_PRESSED
 };
 
@@ -53,19 +53,12 @@ int main(void)
 		.code_addr  = 0
 	};
 
-	struct thread_info print_info = {
-		.name       = "Info",
-		.stack_size = 256,
-		.thread     = print_thread,
-		.class      = REAL_TIME,
-		.arg        = NULL,
-		.code_addr  = 0
-	};
-
-	button_add_callback(&thread_block_cb);
+	button_add_callback(&print_toggle_cb);
 
 	new_thread(&fpi_info);
-	tid = new_thread(&print_info);
+
+	timer_init(&print_timer, print_hello, NULL);
+	timer_start(&print_timer, 500, 500);
 	
 	scheduler_start();
 }
@@ -4,6 +4,8 @@
 #include "bootloader.h"
 #include "dynamic_linker.h"
 #include "mm.h"
+#include "bmalloc.h"
+#include "slab.h"
 #include "thread.h"
 
 /*
@@ -12,9 +14,10 @@
 extern volatile struct frame frame;
 
 /*
- * This functions polls after frames on the host interface
+ * This functions waits for frames on the host interface
  * (which is shared whith the bootloader). It can recevie 
- * and start new applications directly
+ * and start new applications directly. The thread is blocked
+ * until the USART handler has received a complete frame
  */
 void fpi(void* arg) {
 	
@@ -24,11 +27,12 @@ void fpi(void* arg) {
 	tid_t curr_tid = 0;
 
 	while (1) {
-		if (check_new_frame()) {
+		if (wait_new_frame()) {
 
 			if (frame.cmd == 0x01) {
 				u32 size = *(u32 *)frame.payload;
-				binary_buffer = (u8 *)mm_alloc(size, SRAM);
+				/* The application does not clear its own .bss */
+				binary_buffer = (u8 *)bcalloc(size, BMALLOC_SRAM);
 				buffer_ptr = binary_buffer;
 			} else if ((frame.cmd == 0x02) || (frame.cmd == 0x03)) {
 
@@ -44,6 +48,21 @@ void fpi(void* arg) {
 
 					curr_tid = dynamic_linker_run((u32 *)binary_buffer);
 				}
+			} else if (frame.cmd == 0x04) {
+				/*
+				 * Print the memory statistics to the console. The
+				 * print might block, so it is done after reading
+				 */
+				for (u32 i = SRAM; i <= DRAM_BANK_4; i++) {
+					struct mm_stats stats;
+
+					suspend_scheduler();
+					mm_get_stats((enum physmem_e)i, &stats);
+					resume_scheduler();
+
+					mm_print_stats((enum physmem_e)i, &stats);
+				}
+				slab_print_stats();
 			}
 			send_response(RESP_OK);
 		}
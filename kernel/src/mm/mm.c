@@ -3,6 +3,7 @@
 #include "mm.h"
 #include "panic.h"
 #include "print.h"
+#include "cpu.h"
 
 #include <stddef.h>
 
@@ -26,10 +27,31 @@ extern u32 _heap_e;
                                      ((physmem) << 28))
 
 /*
- * Gets and sets the block size encoded in the lower 28 bits
+ * Gets and sets the block size encoded in bits 27..3
  */
-#define mm_get_size(size) ((size) & 0xFFFFFFF)
-#define mm_set_size(size, new_size) (((size) & ~0xFFFFFFF) | (new_size))
+#define mm_get_size(size) ((size) & 0xFFFFFF8)
+#define mm_set_size(size, new_size) (((size) & ~0xFFFFFF8) | (new_size))
+
+/*
+ * The lower bits of the size field are used as flags since the size is a
+ * multiple of `MM_ALIGN`
+ */
+#define MM_FREE      0x1
+#define MM_PREV_FREE 0x2
+
+/* Marks an allocated block */
+#define MM_OWNER ((struct mm_node *)0xC0DEBABE)
+
+/*
+ * A free block has the previous block in its free list after the header, and
+ * its size in the last word of the block. The last word lets the next block
+ * find the start of this block when they are merged. This is why a block is
+ * never smaller than 16 bytes
+ */
+struct mm_free {
+    struct mm_node node;
+    struct mm_free* prev;
+};
 
 /*
  * Configure all regions which will be used by the memory alloctor. Only one
@@ -85,10 +107,155 @@ struct physmem* physical_memories[6] = {
     NULL
 };
 
+/*
+ * Returns the index of the highest and the lowest set bit
+ */
+static inline u32 mm_fls(u32 value) {
+    return 31 - cpu_clz(value);
+}
+
+static inline u32 mm_ffs(u32 value) {
+    return cpu_ctz(value);
+}
+
+/*
+ * Returns the free list indexes for a block of `size` bytes
+ */
+static inline void mm_mapping(u32 size, u32* fl, u32* sl) {
+    if (size < MM_SMALL_BLOCK) {
+        *fl = 0;
+        *sl = size / (MM_SMALL_BLOCK / MM_SL_COUNT);
+    } else {
+        u32 bit = mm_fls(size);
+        *sl = (size >> (bit - MM_SL_BITS)) ^ MM_SL_COUNT;
+        *fl = bit - (MM_FL_SHIFT - 1);
+    }
+}
+
+static inline struct mm_node* mm_phys_next(struct mm_node* node) {
+    return (struct mm_node *)((u8 *)node + mm_get_size(node->size));
+}
+
+static inline void mm_set_footer(struct mm_node* node, u32 size) {
+    *(u32 *)((u8 *)node + size - sizeof(u32)) = size;
+}
+
+/*
+ * Inserts a free block first in its free list
+ */
+static void mm_list_insert(struct physmem* physmem, struct mm_node* node) {
+    u32 fl, sl;
+    mm_mapping(mm_get_size(node->size), &fl, &sl);
+
+    struct mm_free* block = (struct mm_free *)node;
+    struct mm_free* first = (struct mm_free *)physmem->free[fl][sl];
+
+    block->node.next = (struct mm_node *)first;
+    block->prev = NULL;
+    if (first) {
+        first->prev = block;
+    }
+    physmem->free[fl][sl] = node;
+
+    physmem->fl_bitmap |= (1 << fl);
+    physmem->sl_bitmap[fl] |= (1 << sl);
+
+    physmem->free_blocks++;
+    physmem->histogram[fl]++;
+}
+
+/*
+ * Removes a free block from its free list
+ */
+static void mm_list_remove(struct physmem* physmem, struct mm_node* node) {
+    u32 fl, sl;
+    mm_mapping(mm_get_size(node->size), &fl, &sl);
+
+    struct mm_free* block = (struct mm_free *)node;
+    struct mm_free* next = (struct mm_free *)block->node.next;
+
+    physmem->free_blocks--;
+    physmem->histogram[fl]--;
+
+    if (next) {
+        next->prev = block->prev;
+    }
+    if (block->prev) {
+        block->prev->node.next = (struct mm_node *)next;
+    } else {
+        physmem->free[fl][sl] = (struct mm_node *)next;
+
+        if (next == NULL) {
+            physmem->sl_bitmap[fl] &= ~(1 << sl);
+            if (physmem->sl_bitmap[fl] == 0) {
+                physmem->fl_bitmap &= ~(1 << fl);
+            }
+        }
+    }
+}
+
+/*
+ * Returns a free block of at least `size` bytes, or NULL. The size is
+ * rounded up to the next list, so any block in that list is big enough
+ */
+static struct mm_node* mm_find(struct physmem* physmem, u32 size) {
+    u32 fl, sl;
+    u32 search = size;
+
+    if (search >= MM_SMALL_BLOCK) {
+        search += (1 << (mm_fls(search) - MM_SL_BITS)) - 1;
+    }
+    mm_mapping(search, &fl, &sl);
+
+    /* Look for a list in the same level first, then in a higher level */
+    u32 sl_map = 0;
+    if (fl < MM_FL_COUNT) {
+        sl_map = physmem->sl_bitmap[fl] & (~0UL << sl);
+        if (sl_map == 0) {
+            u32 fl_map = physmem->fl_bitmap & (~0UL << (fl + 1));
+            if (fl_map) {
+                fl = mm_ffs(fl_map);
+                sl_map = physmem->sl_bitmap[fl];
+            }
+        }
+    }
+    if (sl_map) {
+        return physmem->free[fl][mm_ffs(sl_map)];
+    }
+
+    /*
+     * No list is guaranteed to fit the block. The first block in the list of
+     * the exact size might still fit, which is always the case when the
+     * entire memory is requested
+     */
+    mm_mapping(size, &fl, &sl);
+    struct mm_node* node = physmem->free[fl][sl];
+    if (node && (mm_get_size(node->size) >= size)) {
+        return node;
+    }
+    return NULL;
+}
+
+/*
+ * Marks a block as free and inserts it into the free lists. The block must
+ * not have a free block on either side
+ */
+static void mm_make_free(struct physmem* physmem, struct mm_node* node,
+    u32 size, u8 index) {
+
+    node->size = mm_set_region(size | MM_FREE, index);
+    mm_set_footer(node, size);
+
+    struct mm_node* next = mm_phys_next(node);
+    next->size |= MM_PREV_FREE;
+
+    mm_list_insert(physmem, node);
+}
+
 /*
  * Initialize all the physical memories used by the memory allocator. After
- * this function the `root_obj` will point to the first valid node in the
- * physical memory. This node will contain the entire memory size
+ * this function each physical memory has one free block containing the
+ * entire memory size
  */
 void mm_init(void) {
     u8 index = 0;
@@ -105,13 +272,11 @@ void mm_init(void) {
             physmem->end_addr = (u32)&_heap_e;
         }
 
-        /* Erase the memory */
-        volatile u8* clear_start = (volatile u8 *)physmem->start_addr;
-        volatile u8* clear_end = (volatile u8 *)physmem->end_addr;
-
-        while (clear_start != clear_end) {
-            *clear_start++ = 0x00;
-        }
+        /*
+         * The memory is not erased. Only the allocator nodes are written
+         * here, and memory which must be zero is allocated with the `calloc`
+         * functions
+         */
 
         /* Align the start address upwards */
         if (physmem->start_addr & (MM_ALIGN - 1)) {
@@ -136,93 +301,45 @@ void mm_init(void) {
         physmem->size = (physmem->end_addr - sizeof(struct mm_node) -
                          physmem->start_addr);
 
-        /*
-         * The first node will not contain any data hence the size should be
-         * zero, and it will point to the first physical node
-         */
-        physmem->root_obj.size = 0;
-        physmem->root_obj.next = node_start;
+        u32 fl, sl;
+        mm_mapping(physmem->size, &fl, &sl);
+        if (fl >= MM_FL_COUNT) {
+            panic("Physical memory too large");
+        }
 
-        /* Remap the physical memory pointers */
-        physmem->last_node = node_end;
-        physmem->root_node = &physmem->root_obj;
-        
-        node_start->next = node_end;
-        node_start->size = mm_set_size(0, physmem->size);
-        node_start->size = mm_set_region(node_start->size, index);
+        physmem->fl_bitmap = 0;
+        physmem->free_blocks = 0;
+        for (u32 i = 0; i < MM_FL_COUNT; i++) {
+            physmem->histogram[i] = 0;
+            physmem->sl_bitmap[i] = 0;
+            for (u32 j = 0; j < MM_SL_COUNT; j++) {
+                physmem->free[i][j] = NULL;
+            }
+        }
 
-        /*
-         * In the `first fit` algorithm the last node is a zero-sized node
-         * pointing to NULL
-         */
-        node_end->next = NULL;
+        /* The last node is never free, so nothing is merged with it */
+        node_end->next = MM_OWNER;
         node_end->size = 0;
+        physmem->last_node = node_end;
+
+        node_start->size = 0;
+        mm_make_free(physmem, node_start, physmem->size, index);
 
         physmem->allocated = 0;
+        physmem->peak = 0;
+        physmem->allocs = 0;
+        physmem->fails = 0;
+        physmem->fail_size = 0;
         index++;
     }
 }
 
 /*
- * Inserts a `mm_node` into the free list, and combines adjacent blocks if
- * present. `first` should be a pointer to the pysical memory root object.
- * `last` should be a pointer to the last node
- */
-void mm_list_insert(struct mm_node* node, struct mm_node* root, 
-    struct mm_node* last) {
-
-    if ((node < root ) || (node > last)) {
-        panic("Memory list error");
-    }
-
-    struct mm_node* iter = root;
-
-    while (iter->next < node) {
-        iter = iter->next;
-    }
-
-    u32 iter_size = mm_get_size(iter->size);
-    u32 insert_size = mm_get_size(node->size);
-
-    /* Check for backwards block overlap */
-    if (((u8 *)iter + iter_size) == (u8 *)node) {
-        iter->size += insert_size;
-        node = iter;
-    }
-    
-
-    /* Check for forward block overlap */
-    u32 next_size = mm_get_size(iter->next->size);
-    insert_size = mm_get_size(node->size);
-
-    if (((u8 *)node + insert_size) == (u8 *)iter->next) {
-        /* No block can be merged with the last block */
-        if (iter->next == last) {
-            node->next = last;
-        } else {
-            node->size += next_size;
-            node->next = iter->next->next;         
-        }
-    } else {
-        node->next = iter->next;
-    }
-
-    /*
-     * If the block to insert is not merged backwards, the `node` and `iter` 
-     * have different address. Then these nodes has to be linked together
-     */
-    if (node != iter) {
-        iter->next = node;
-    }
-}
-
-/*
- * Allocates `size` number of bytes from a physical memory
+ * Allocates `size` number of bytes from a physical memory in constant time
  */
 void* mm_alloc(u32 size, enum physmem_e index) {
 
     struct physmem* physmem = physical_memories[index];
-    void* return_ptr = NULL;
 
     /* The size should contain the `mm_node`  */
     size += sizeof(struct mm_node);
@@ -241,65 +358,55 @@ void* mm_alloc(u32 size, enum physmem_e index) {
         size &= ~(MM_ALIGN - 1);
     }
 
-    if (size > (physmem->size - physmem->allocated)) {
-        print("Not enough memory");
-        return NULL;
-    }
-
-    struct mm_node* iter = physmem->root_node->next;
-    struct mm_node* iter_prev = physmem->root_node;
+    physmem->allocs++;
 
-    /* Try to find a free block which is big enough */
-    while (iter->next != NULL) {
-        if (mm_get_size(iter->size) >= size) {
-            break;
-        }
-        iter_prev = iter;
-        iter = iter->next;
+    /*
+     * The request fails if there is not enough free memory, or if the free
+     * memory is too fragmented
+     */
+    struct mm_node* node = NULL;
+    if (size <= (physmem->size - physmem->allocated)) {
+        node = mm_find(physmem, size);
     }
-
-    if (iter->next == NULL) {
+    if (node == NULL) {
+        physmem->fails++;
+        physmem->fail_size = size;
+        print("Not enough memory in %s\n", physmem->name);
         return NULL;
     }
+    mm_list_remove(physmem, node);
 
-    /*
-     * The `iter` is pointing to a memory block which is large enough to
-     * contain the requested memory.
-     */
-    u32 curr_block_size = mm_get_size(iter->size);
-
-    return_ptr = (void *)((u8 *)iter + sizeof(struct mm_node));
-
-    /* Remove the current block from the list */
-    iter_prev->next = iter->next;
+    u32 curr_block_size = mm_get_size(node->size);
 
     /*
      * Check if the remaining part of the block is big enough to contain a
-     * new memory block
+     * new memory block. The block in front of a free block is never free
      */
     if (size + physmem->min_alloc <= curr_block_size) {
+        struct mm_node* new_node = (struct mm_node *)((u8 *)node + size);
 
-        struct mm_node* new_node = (struct mm_node *)((u8 *)iter + size);
-
-        new_node->size = mm_set_region(new_node->size, index);
-        new_node->size = mm_set_size(new_node->size, curr_block_size - size);
-
-        physmem->allocated += size;
-        iter->size = mm_set_size(iter->size, size);
-
-        mm_list_insert(new_node, physmem->root_node, physmem->last_node);
+        new_node->size = 0;
+        mm_make_free(physmem, new_node, curr_block_size - size, index);
     } else {
-        physmem->allocated += curr_block_size;
+        size = curr_block_size;
+        mm_phys_next(node)->size &= ~MM_PREV_FREE;
+    }
+
+    node->size = mm_set_region(size, index);
+    physmem->allocated += size;
+    if (physmem->allocated > physmem->peak) {
+        physmem->peak = physmem->allocated;
     }
 
     /* Mark the memory as allocated */
-    iter->next = (struct mm_node *)0xC0DEBABE;
+    node->next = MM_OWNER;
 
-    return return_ptr;
+    return (void *)((u8 *)node + sizeof(struct mm_node));
 }
 
 /*
- * Free memory
+ * Frees memory in constant time. The block is merged with the free blocks
+ * next to it
  */
 void mm_free(void* memory) {
 
@@ -312,15 +419,36 @@ void mm_free(void* memory) {
         sizeof(struct mm_node));
 
     /* Check if the memory pointer has been allocated by the mm_alloc */
-    if ((u32)node->next != 0xC0DEBABE) {
+    if (node->next != MM_OWNER) {
         panic("Pointer not made by mm_alloc*");
     }
 
-    u8 physmem = mm_get_region(node->size);
-    struct physmem* region = physical_memories[physmem];
-    region->allocated -= mm_get_size(node->size);
-    
-    mm_list_insert(node, region->root_node, region->last_node);
+    u8 index = mm_get_region(node->size);
+    struct physmem* physmem = physical_memories[index];
+
+    if (((u32)node < physmem->start_addr) || (node >= physmem->last_node)) {
+        panic("Memory list error");
+    }
+
+    u32 size = mm_get_size(node->size);
+    physmem->allocated -= size;
+
+    /* Merge with the next block */
+    struct mm_node* next = mm_phys_next(node);
+    if (next->size & MM_FREE) {
+        mm_list_remove(physmem, next);
+        size += mm_get_size(next->size);
+    }
+
+    /* Merge with the previous block, which has its size in its last word */
+    if (node->size & MM_PREV_FREE) {
+        u32 prev_size = *((u32 *)node - 1);
+        node = (struct mm_node *)((u8 *)node - prev_size);
+        mm_list_remove(physmem, node);
+        size += prev_size;
+    }
+
+    mm_make_free(physmem, node, size, index);
 }
 
 /*
@@ -347,8 +475,85 @@ u32 mm_get_free(enum physmem_e physmem) {
 }
 
 /*
- * Returns the fragmentation of the current pytsical memory
+ * Returns the size of the largest free block in a physical memory. Only the
+ * highest non-empty free list is searched, since the blocks in all other
+ * lists are smaller
+ */
+u32 mm_get_largest_free(enum physmem_e physmem) {
+    struct physmem* mem = physical_memories[physmem];
+
+    if (mem->fl_bitmap == 0) {
+        return 0;
+    }
+    u32 fl = mm_fls(mem->fl_bitmap);
+    u32 sl = mm_fls(mem->sl_bitmap[fl]);
+
+    u32 largest = 0;
+    struct mm_node* node = mem->free[fl][sl];
+    while (node) {
+        if (mm_get_size(node->size) > largest) {
+            largest = mm_get_size(node->size);
+        }
+        node = node->next;
+    }
+
+    /* The block header is not available to the user */
+    return largest - sizeof(struct mm_node);
+}
+
+/*
+ * Returns the fragmentation of the current pytsical memory in percent. This
+ * is the part of the free memory which can not be allocated in one block
  */
 u32 mm_get_frag(enum physmem_e physmem) {
-    return 0;
+    u32 free = mm_get_free(physmem);
+    if (free == 0) {
+        return 0;
+    }
+    u32 largest = mm_get_largest_free(physmem) + sizeof(struct mm_node);
+    return 100 - (u32)(((u64)largest * 100) / free);
+}
+
+/*
+ * Copies the statistics of a physical memory
+ */
+void mm_get_stats(enum physmem_e physmem, struct mm_stats* stats) {
+    struct physmem* mem = physical_memories[physmem];
+
+    stats->total = mem->size;
+    stats->used = mem->allocated;
+    stats->peak = mem->peak;
+    stats->largest_free = mm_get_largest_free(physmem);
+    stats->free_blocks = mem->free_blocks;
+    stats->frag = mm_get_frag(physmem);
+
+    stats->allocs = mem->allocs;
+    stats->fails = mem->fails;
+    stats->fail_size = mem->fail_size;
+
+    for (u32 i = 0; i < MM_FL_COUNT; i++) {
+        stats->histogram[i] = mem->histogram[i];
+    }
+}
+
+/*
+ * Prints the statistics of a physical memory read by `mm_get_stats`
+ */
+void mm_print_stats(enum physmem_e physmem, struct mm_stats* stats) {
+    print("%s\n", physical_memories[physmem]->name);
+    print("  used %d of %d - peak %d\n", stats->used, stats->total,
+        stats->peak);
+    print("  free blocks %d - largest %d\n", stats->free_blocks,
+        stats->largest_free);
+    print("  fragmentation %d percent\n", stats->frag);
+    print("  allocs %d - fails %d - last %d\n", stats->allocs,
+        stats->fails, stats->fail_size);
+
+    /* Only the non-empty size classes are printed */
+    for (u32 i = 0; i < MM_FL_COUNT; i++) {
+        if (stats->histogram[i]) {
+            u32 limit = (i == 0) ? MM_SMALL_BLOCK : (1 << (i + 7));
+            print("  < %d: %d\n", limit, stats->histogram[i]);
+        }
+    }
 }
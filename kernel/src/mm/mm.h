@@ -15,12 +15,31 @@ enum physmem_e {
     DRAM_BANK_4
 };
 
+/*
+ * The TLSF free lists are indexed by a first level, which is the power of two
+ * of the block size, and a second level which splits each power of two in
+ * `MM_SL_COUNT` linear ranges. Blocks below `MM_SMALL_BLOCK` all use the first
+ * list of the first level. The first level count limits the largest region to
+ * 4 MiB
+ */
+#define MM_SL_BITS     4
+#define MM_SL_COUNT    (1 << MM_SL_BITS)
+#define MM_FL_SHIFT    (MM_SL_BITS + 3)
+#define MM_SMALL_BLOCK (1 << MM_FL_SHIFT)
+#define MM_FL_COUNT    16
+
 struct mm_node {
+    /*
+     * Next block in the free list. Allocated blocks have this field set to
+     * 0xC0DEBABE
+     */
     struct mm_node* next;
 
     /*
      * [31..28] - physical memory index
-     * [27..0]  - memory block size
+     * [27..3]  - memory block size
+     * [1]      - the block in front of this one is free
+     * [0]      - this block is free
      */
     u32 size;
 };
@@ -44,15 +63,52 @@ struct physmem {
     char name[PHYSMEM_NAME_LENGTH];
 
     /*
-     * The `root_obj` will contain the first node in the free linked
-     * list, and point to the fist node in the physical memory. The
-     * `root_node` is pointing to the `root_obj`. The `last_node`
-     * will point to the last node in the physical memory, and have
-     * size zero.
-     */ 
-    struct mm_node* root_node;
+     * Free lists of the TLSF allocator. A bit is set in the `fl_bitmap` for
+     * each first level with a non-empty list, and in the `sl_bitmap` for each
+     * non-empty list in that level
+     */
+    u32 fl_bitmap;
+    u32 sl_bitmap[MM_FL_COUNT];
+    struct mm_node* free[MM_FL_COUNT][MM_SL_COUNT];
+
+    /*
+     * The `last_node` is an allocated zero-sized node at the end of the
+     * physical memory, so no block is merged past the end
+     */
     struct mm_node* last_node;
-    struct mm_node root_obj;
+
+    /*
+     * Statistics updated on every allocation and free. The histogram counts
+     * the free blocks in each first level of the free lists
+     */
+    u32 peak;
+    u32 allocs;
+    u32 fails;
+    u32 fail_size;
+    u32 free_blocks;
+    u32 histogram[MM_FL_COUNT];
+};
+
+/*
+ * Statistics of a physical memory. The fragmentation is the part of the free
+ * memory, in percent, which is not in the largest free block. Histogram
+ * entry 0 counts the free blocks below `MM_SMALL_BLOCK` bytes, and entry n
+ * the free blocks from 2^(n + 6) up to 2^(n + 7) bytes
+ */
+struct mm_stats {
+    u32 total;
+    u32 used;
+    u32 peak;
+    u32 largest_free;
+    u32 free_blocks;
+    u32 frag;
+
+    /* Number of allocations, failed allocations and the last failed size */
+    u32 allocs;
+    u32 fails;
+    u32 fail_size;
+
+    u32 histogram[MM_FL_COUNT];
 };
 
 void mm_init(void);
@@ -69,4 +125,10 @@ u32 mm_get_free(enum physmem_e physmem);
 
 u32 mm_get_frag(enum physmem_e physmem);
 
+u32 mm_get_largest_free(enum physmem_e physmem);
+
+void mm_get_stats(enum physmem_e physmem, struct mm_stats* stats);
+
+void mm_print_stats(enum physmem_e physmem, struct mm_stats* stats);
+
 #endif
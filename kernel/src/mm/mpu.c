@@ -120,3 +120,14 @@ void mpu_configure_region(u8 reg_num, u32 addr, struct mpu_region* reg_desc) {
     isb();
     MPU->RASR = rasr;
 }
+
+/*
+ * Moves an allready configured region to a new base address. The size and
+ * attributes are kept. Writing RBAR with the VALID bit set selects the
+ * region in the same write, so this is fast enough for the context switch
+ */
+void mpu_move_region(u8 reg_num, u32 addr) {
+    MPU->RBAR = addr | (1 << 4) | (reg_num & 0xF);
+    dsb();
+    isb();
+}
@@ -64,6 +64,8 @@ u8 mpu_get_data_regions(void);
 
 void mpu_configure_region(u8 reg_num, u32 addr, struct mpu_region* reg_desc);
 
+void mpu_move_region(u8 reg_num, u32 addr);
+
 void mpu_enable(void);
 
 void mpu_disable(void);
@@ -0,0 +1,328 @@
+/* Copyright (C) StrawberryHacker */
+
+#include "slab.h"
+#include "umalloc.h"
+#include "bmalloc.h"
+#include "memory.h"
+#include "print.h"
+#include "panic.h"
+#include "cpu.h"
+#include "scheduler.h"
+
+#include <stddef.h>
+
+/*
+ * Defined in scheduler.c
+ */
+extern volatile u8 scheduler_status;
+
+/*
+ * Each object is placed in a umalloc block after a header pointing to the
+ * slab owning the block. This makes `slab_free` independent of the number of
+ * slabs. The second header word keeps the objects 8 byte aligned, and holds a
+ * magic number for catching pointers not made by `slab_alloc`
+ */
+#define SLAB_HEADER_SIZE 8
+#define SLAB_ALIGN 8
+#define SLAB_MAGIC 0x51AB51AB
+
+struct slab {
+    struct umalloc_desc arena;
+    struct slab_cache* cache;
+    struct dlist_node node;
+};
+
+/*
+ * All caches which have grown at least once. Used for printing statistics
+ */
+static struct dlist slab_caches;
+
+/*
+ * Initializes a slab cache. The cache does not use any memory before the
+ * first allocation
+ */
+void slab_cache_init(struct slab_cache* cache, const char* name, u32 obj_size,
+    u32 slab_objects, enum pmalloc_bank bank, void (*ctor)(void*))
+{
+    memory_fill(cache, 0x00, sizeof(struct slab_cache));
+
+    if (string_len(name) >= SLAB_NAME_LENGTH) {
+        panic("Slab name too long");
+    }
+    string_copy(name, cache->name);
+
+    cache->obj_size = obj_size;
+    cache->slab_objects = slab_objects;
+    cache->bank = bank;
+    cache->ctor = ctor;
+}
+
+/*
+ * The heap is protected by suspending the scheduler, while interrupts stay
+ * enabled. The caller might have suspended the scheduler allready, so it is
+ * only resumed if it was running
+ */
+static u8 slab_heap_lock(void)
+{
+    u8 running = scheduler_status;
+    suspend_scheduler();
+    return running;
+}
+
+static void slab_heap_unlock(u8 running)
+{
+    if (running) {
+        resume_scheduler();
+    }
+}
+
+/*
+ * Adds a new slab to the cache. The memory is taken from the heap with
+ * interrupts enabled, and only the slab lists are changed with interrupts
+ * disabled. This can not be called from exception handlers
+ */
+static void slab_grow(struct slab_cache* cache)
+{
+    if ((cache->obj_size == 0) || (cache->slab_objects == 0)) {
+        panic("Slab cache not initialized");
+    }
+
+    u8 running = slab_heap_lock();
+
+    struct slab* slab = (struct slab *)bmalloc(sizeof(struct slab),
+        BMALLOC_SRAM);
+
+    u32 block_size = (cache->obj_size + SLAB_HEADER_SIZE + SLAB_ALIGN - 1) &
+        ~(SLAB_ALIGN - 1);
+    umalloc_new(&slab->arena, block_size, cache->slab_objects, cache->bank);
+
+    slab_heap_unlock(running);
+
+    slab->cache = cache;
+    dlist_node_init(&slab->node);
+    slab->node.obj = slab;
+
+    u32 primask = cpu_get_primask();
+    cpsid_i();
+
+    dlist_insert_first(&slab->node, &cache->partial);
+
+    if (cache->stats.slabs == 0) {
+        dlist_node_init(&cache->cache_node);
+        cache->cache_node.obj = cache;
+        dlist_insert_last(&cache->cache_node, &slab_caches);
+    }
+
+    cache->stats.slabs++;
+    cache->stats.bytes += block_size * slab->arena.block_count;
+    cache->stats.total += slab->arena.block_count;
+
+    cpu_set_primask(primask);
+}
+
+/*
+ * Takes a slab with no objects in use out of the cache. Must be called with
+ * interrupts disabled. The memory is given back by `slab_release`
+ */
+static void slab_unlink(struct slab_cache* cache, struct slab* slab)
+{
+    dlist_remove(&slab->node, &cache->partial);
+
+    cache->stats.slabs--;
+    cache->stats.bytes -= slab->arena.block_size * slab->arena.block_count;
+    cache->stats.total -= slab->arena.block_count;
+
+    if (cache->stats.slabs == 0) {
+        dlist_remove(&cache->cache_node, &slab_caches);
+    }
+}
+
+/*
+ * Gives the memory of an unlinked slab back to the heap
+ */
+static void slab_release(struct slab* slab)
+{
+    u8 running = slab_heap_lock();
+
+    umalloc_delete(&slab->arena);
+    bfree(slab);
+
+    slab_heap_unlock(running);
+}
+
+/*
+ * Deletes all slabs of a cache. All objects must be freed before this
+ */
+void slab_cache_delete(struct slab_cache* cache)
+{
+    if (cache->stats.used) {
+        panic("Slab cache in use");
+    }
+    slab_cache_shrink(cache);
+}
+
+/*
+ * Grows the cache until at least `count` objects are free, so that later
+ * allocations do not touch the heap. Returns the number of free objects
+ */
+u32 slab_cache_reserve(struct slab_cache* cache, u32 count)
+{
+    u32 primask = cpu_get_primask();
+    cpsid_i();
+
+    while ((cache->stats.total - cache->stats.used) < count) {
+        cpu_set_primask(primask);
+        slab_grow(cache);
+        cpsid_i();
+    }
+    u32 free = cache->stats.total - cache->stats.used;
+
+    cpu_set_primask(primask);
+    return free;
+}
+
+/*
+ * Gives all slabs with no objects in use back to pmalloc. Returns the number
+ * of slabs released
+ */
+u32 slab_cache_shrink(struct slab_cache* cache)
+{
+    struct dlist empty;
+    dlist_init(&empty);
+
+    u32 primask = cpu_get_primask();
+    cpsid_i();
+
+    u32 count = 0;
+    struct dlist_node* node = cache->partial.first;
+    while (node) {
+        struct slab* slab = (struct slab *)node->obj;
+        node = node->next;
+
+        if (umalloc_get_used(&slab->arena) == 0) {
+            slab_unlink(cache, slab);
+            dlist_insert_last(&slab->node, &empty);
+            count++;
+        }
+    }
+
+    cpu_set_primask(primask);
+
+    /* No one can allocate from the unlinked slabs */
+    while ((node = dlist_remove_first(&empty))) {
+        slab_release((struct slab *)node->obj);
+    }
+    return count;
+}
+
+/*
+ * Allocates an object from a slab cache and runs the constructor on it. The
+ * cache only grows from thread mode, since pmalloc can not be used from
+ * exception handlers. An exception handler gets NULL if the cache has no
+ * free objects
+ */
+void* slab_alloc(struct slab_cache* cache)
+{
+    u32 primask = cpu_get_primask();
+    cpsid_i();
+
+    cache->stats.allocs++;
+
+    /* Another caller might take the new slab before the cache is locked */
+    while (cache->partial.first == NULL) {
+        if (cpu_get_ipsr()) {
+            cache->stats.fails++;
+            cpu_set_primask(primask);
+            return NULL;
+        }
+        cpu_set_primask(primask);
+        slab_grow(cache);
+        cpsid_i();
+    }
+    struct slab* slab = (struct slab *)cache->partial.first->obj;
+
+    u32* block = (u32 *)umalloc(&slab->arena);
+    block[0] = (u32)slab;
+    block[1] = SLAB_MAGIC;
+
+    /* Move the slab to the full list when the last object is taken */
+    if (umalloc_get_used(&slab->arena) == slab->arena.block_count) {
+        dlist_remove(&slab->node, &cache->partial);
+        dlist_insert_first(&slab->node, &cache->full);
+    }
+
+    if (++cache->stats.used > cache->stats.peak) {
+        cache->stats.peak = cache->stats.used;
+    }
+    cpu_set_primask(primask);
+
+    void* obj = (u8 *)block + SLAB_HEADER_SIZE;
+    if (cache->ctor) {
+        cache->ctor(obj);
+    }
+    return obj;
+}
+
+/*
+ * Gives an object back to its slab cache. Empty slabs are kept by the cache
+ * until `slab_cache_shrink` is called
+ */
+void slab_free(void* obj)
+{
+    if (obj == NULL) {
+        panic("Trying to free NULL pointer");
+    }
+
+    u32* block = (u32 *)((u8 *)obj - SLAB_HEADER_SIZE);
+    if (block[1] != SLAB_MAGIC) {
+        panic("Pointer not made by slab_alloc");
+    }
+    struct slab* slab = (struct slab *)block[0];
+    struct slab_cache* cache = slab->cache;
+
+    u32 primask = cpu_get_primask();
+    cpsid_i();
+
+    /* A full slab gets a free object */
+    if (umalloc_get_used(&slab->arena) == slab->arena.block_count) {
+        dlist_remove(&slab->node, &cache->full);
+        dlist_insert_first(&slab->node, &cache->partial);
+    }
+    ufree(&slab->arena, block);
+    cache->stats.used--;
+
+    cpu_set_primask(primask);
+}
+
+/*
+ * Copies the statistics of a slab cache
+ */
+void slab_get_stats(struct slab_cache* cache, struct slab_stats* stats)
+{
+    u32 primask = cpu_get_primask();
+    cpsid_i();
+    *stats = cache->stats;
+    cpu_set_primask(primask);
+}
+
+/*
+ * Prints the statistics of all slab caches in use
+ */
+void slab_print_stats(void)
+{
+    struct dlist_node* node = slab_caches.first;
+
+    while (node) {
+        struct slab_cache* cache = (struct slab_cache *)node->obj;
+        struct slab_stats stats;
+        slab_get_stats(cache, &stats);
+
+        print("%s\n", cache->name);
+        print("  slabs %d - %d bytes\n", stats.slabs, stats.bytes);
+        print("  used %d of %d - peak %d\n", stats.used, stats.total,
+            stats.peak);
+        print("  allocs %d - fails %d\n", stats.allocs, stats.fails);
+
+        node = node->next;
+    }
+}
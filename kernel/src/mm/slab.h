@@ -0,0 +1,85 @@
+/* Copyright (C) StrawberryHacker */
+
+/*
+ * Slab caches hand out objects of one type. Each cache is grown on demand
+ * with slabs, where one slab is a umalloc arena taken from pmalloc. All
+ * objects in a cache have the same size, so there is no internal
+ * fragmentation from the `min_alloc` of the physical memory, and an
+ * allocation never searches the general heap once the cache has grown
+ */
+
+#ifndef SLAB_H
+#define SLAB_H
+
+#include "types.h"
+#include "pmalloc.h"
+#include "dlist.h"
+
+#define SLAB_NAME_LENGTH 16
+
+struct slab_stats {
+    /* Number of slabs and the memory they hold */
+    u32 slabs;
+    u32 bytes;
+
+    /* Number of objects in the slabs, in use and the highest number in use */
+    u32 total;
+    u32 used;
+    u32 peak;
+
+    /* Number of calls to `slab_alloc` and failed allocations */
+    u32 allocs;
+    u32 fails;
+};
+
+struct slab_cache {
+    char name[SLAB_NAME_LENGTH];
+
+    /* Size of each object and number of objects in a new slab */
+    u32 obj_size;
+    u32 slab_objects;
+    enum pmalloc_bank bank;
+
+    /* Called on every object returned by `slab_alloc`. This can be NULL */
+    void (*ctor)(void* obj);
+
+    /* Slabs with at least one free object and slabs with none */
+    struct dlist partial;
+    struct dlist full;
+
+    struct slab_stats stats;
+
+    /* A cache is added to the list of caches when it gets its first slab */
+    struct dlist_node cache_node;
+};
+
+/*
+ * Static initializer for a slab cache. No memory is used before the first
+ * allocation
+ */
+#define SLAB_CACHE_INIT(_name, _obj_size, _slab_objects, _bank, _ctor) { \
+    .name = _name, \
+    .obj_size = _obj_size, \
+    .slab_objects = _slab_objects, \
+    .bank = _bank, \
+    .ctor = _ctor \
+}
+
+void slab_cache_init(struct slab_cache* cache, const char* name, u32 obj_size,
+    u32 slab_objects, enum pmalloc_bank bank, void (*ctor)(void*));
+
+void slab_cache_delete(struct slab_cache* cache);
+
+u32 slab_cache_reserve(struct slab_cache* cache, u32 count);
+
+u32 slab_cache_shrink(struct slab_cache* cache);
+
+void* slab_alloc(struct slab_cache* cache);
+
+void slab_free(void* obj);
+
+void slab_get_stats(struct slab_cache* cache, struct slab_stats* stats);
+
+void slab_print_stats(void);
+
+#endif
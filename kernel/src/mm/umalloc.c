@@ -1,9 +1,12 @@
 /* Copyright (C) StrawberryHacker */
 
 #include "umalloc.h"
+#include "mm.h"
 #include "print.h"
 #include "panic.h"
 #include "memory.h"
+#include "cpu.h"
+#include "exclusive.h"
 #include "umalloc_benchmark.h"
 #include <stddef.h>
 
@@ -35,100 +38,153 @@ static inline u8 addr_to_index(struct umalloc_desc* desc, void* ptr, u32* index)
     return 1;
 }
 
-/* 
- * Returns the value of the bit in the bitmap the given index
+/*
+ * Atomic bit operations used by the exception safe allocator
  */
-static inline u8 get_bitmap_value(struct umalloc_desc* desc, u32 index)
+static inline u32 atomic_clear_bit(volatile u32* word, u32 bit)
 {
-    u32 word_offset = index / 32;
-    u32 bit_offset = index % 32;
+    u32 value;
+    do {
+        value = ldrex(word) & ~(1 << bit);
+    } while (strex(word, value));
+    return value;
+}
 
-    if (*(desc->bitmap + word_offset) & (1 << bit_offset)) {
-        return 1;
-    } else  {
-        return 0;
-    }
+static inline void atomic_set_bit(volatile u32* word, u32 bit)
+{
+    u32 value;
+    do {
+        value = ldrex(word) | (1 << bit);
+    } while (strex(word, value));
+}
+
+static inline void atomic_add(volatile u32* word, u32 value)
+{
+    u32 new_value;
+    do {
+        new_value = ldrex(word) + value;
+    } while (strex(word, new_value));
 }
 
 /*
- * Clears a bit in the bitmap given a index
+ * Marks a bitmap word as having a free block in both summary levels
  */
-static inline void clear_bit_in_bitmap(struct umalloc_desc* desc, u32 index)
+static inline void summary_set(struct umalloc_desc* desc, u32 word)
 {
-    u32 word_offset = index / 32;
-    u32 bit_offset = index % 32;
+    desc->summary[word / 32] |= (1 << (word % 32));
+    desc->top |= (1 << (word / 32));
+}
 
-    *(desc->bitmap + word_offset) |= (1 << bit_offset);
+/*
+ * Marks a block as used and updates the summary levels if the bitmap word or
+ * the summary word became empty
+ */
+static inline void take_index(struct umalloc_desc* desc, u32 word, u32 bit)
+{
+    desc->bitmap[word] &= ~(1 << bit);
+    if (desc->bitmap[word] == 0) {
+        desc->summary[word / 32] &= ~(1 << (word % 32));
+        if (desc->summary[word / 32] == 0) {
+            desc->top &= ~(1 << (word / 32));
+        }
+    }
 }
 
 /*
- * Returns the index of the first free block in the bitmap, and marks that bit
- * as used
+ * Returns the index of the first free block, and marks that block as used.
+ * The bitmap word of the last allocation or free is checked first, and the
+ * summary levels are only searched if it is full
  */
 static inline u8 get_first_free_index(struct umalloc_desc* desc, u32* index)
 {
-    u32 bitmaps = desc->block_count / 32;
-    u32* bitmask_ptr = desc->bitmap;
-
-    for (u32 i = 0; i < bitmaps; ++i) {
-        u32 bitmask = *bitmask_ptr;
-        if (bitmask) {
-            for (u32 j = 0; j < 32; j++) {
-                /* A one in the bitmap indicates a free bit  */
-                if (bitmask & (1 << j)) {
-                    *bitmask_ptr &= ~(1 << j);
-                    *index = (32 * i) + j;
-                    return 1;
-                }
-            }
+    u32 word = desc->hint;
+
+    if (desc->bitmap[word] == 0) {
+        if (desc->top == 0) {
+            return 0;
         }
-        bitmask_ptr++;
+        u32 sum = cpu_ctz(desc->top);
+        word = (sum * 32) + cpu_ctz(desc->summary[sum]);
+        desc->hint = word;
     }
-    return 0;
+
+    /* A one in the bitmap indicates a free block */
+    u32 bit = cpu_ctz(desc->bitmap[word]);
+    take_index(desc, word, bit);
+
+    *index = (word * 32) + bit;
+    return 1;
 }
 
 /*
- * Configures and allocate a bitmap allocator. This will allign the requested
- * block size to 32 for faster allocation. This uses the pmalloc allocator to
- * dynamically manage the bitmap allocators.
+ * Configures and allocate a bitmap allocator. The block count is aligned to 32
+ * so that no bitmap word is partly used. The memory is taken from the same
+ * banks as pmalloc. Returns 0 if the allocator is too large or there is not
+ * enough memory
  */
-void umalloc_new(struct umalloc_desc* desc, u32 block_size, u32 block_count, 
+u8 umalloc_try_new(struct umalloc_desc* desc, u32 block_size, u32 block_count,
     enum pmalloc_bank bank)
 {
     /* Align the block_count to 32 bit. This makes the search faster */
-    block_count = (block_count + 32) & ~(u32)(32 - 1);
+    block_count = (block_count + 31) & ~(u32)(32 - 1);
+    if ((block_count == 0) || (block_count > UMALLOC_MAX_BLOCKS) ||
+        (block_size == 0) || (block_size > UMALLOC_MAX_BLOCK_SIZE)) {
+        return 0;
+    }
 
     u32 arena_size = block_count * block_size;
-    u32 bitmap_size = block_count / 8;
-    if (block_count % 8) {
-        bitmap_size++;
-    }
+    u32 bitmap_words = block_count / 32;
+    u32 summary_words = (bitmap_words + 31) / 32;
+    u32 bitmap_size = (bitmap_words + summary_words) * 4;
 
     /* Find the number of pages to allocate using pmalloc */
     u32 pages = (arena_size + bitmap_size) / 512;
     if ((arena_size + bitmap_size) % 512) {
         pages++;
     }
-    desc->arena = (u8 *)pmalloc(pages, bank);
+    desc->arena = (u8 *)mm_alloc(pages * 512, (enum physmem_e)bank);
 
     if (desc->arena == NULL) {
-        panic("Can not make ualloc");
+        return 0;
     }
 
-    /* Initialize the memory and structure */
-    memory_fill(desc->arena, 0xFF, pages * 512);
-
     desc->block_size = block_size;
     desc->block_count = block_count;
     desc->used_blocks = 0;
 
-    /* Calulate the base address of the bitmap */
+    /*
+     * Calulate the base address of the bitmap and the summary. The arena
+     * size is a multiple of 32 so the bitmap is word aligned
+     */
     desc->bitmap = (u32 *)(desc->arena + arena_size);
+    desc->summary = desc->bitmap + bitmap_words;
+
+    /* All blocks are free */
+    memory_fill(desc->bitmap, 0xFF, bitmap_words * 4);
+    memory_fill(desc->summary, 0x00, summary_words * 4);
+    desc->top = 0;
+    desc->hint = 0;
+
+    for (u32 i = 0; i < bitmap_words; i++) {
+        summary_set(desc, i);
+    }
+    return 1;
+}
+
+/*
+ * Configures and allocate a bitmap allocator. Panics if this fails
+ */
+void umalloc_new(struct umalloc_desc* desc, u32 block_size, u32 block_count,
+    enum pmalloc_bank bank)
+{
+    if (!umalloc_try_new(desc, block_size, block_count, bank)) {
+        panic("Can not make ualloc");
+    }
 }
 
 /*
  * Deletes the bmalloc allocator. All pointer must be freed before calling this
- * functions. Otherwise, memory leaks will occur. 
+ * functions. Otherwise, memory leaks will occur.
  */
 void umalloc_delete(struct umalloc_desc* desc)
 {
@@ -176,18 +232,108 @@ void ufree(struct umalloc_desc* desc, void* ptr)
     if (!addr_to_index(desc, ptr, &index)) {
         panic("bfree failed");
     }
+    u32 word = index / 32;
+    u32 bit = index % 32;
 
     /* Check if the index correspondes with a used entry */
-    if (get_bitmap_value(desc, index) == 1) {
+    if (desc->bitmap[word] & (1 << bit)) {
         panic("bfree failed");
     }
-    clear_bit_in_bitmap(desc, index);
 
     if (desc->used_blocks) {
         desc->used_blocks--;
     } else {
         panic("bfree failed");
     }
+
+    desc->bitmap[word] |= (1 << bit);
+    summary_set(desc, word);
+
+    /* The next allocation reuses this block */
+    desc->hint = word;
+}
+
+/*
+ * Allocates a block without disabling interrupts. Every bit is changed with
+ * LDREX and STREX, so this can be called from exception handlers which
+ * interrupt another call to `umalloc_isr` or `ufree_isr`. An allocator used
+ * like this must only use these two functions. The summary bits are only
+ * hints here. A bit might be set for a full word, and it is cleared again by
+ * the allocator finding the word full. Returns NULL if all blocks are used
+ */
+void* umalloc_isr(struct umalloc_desc* desc)
+{
+    volatile u32* summary = desc->summary;
+
+    while (1) {
+        u32 top = desc->top;
+        if (top == 0) {
+            return NULL;
+        }
+        u32 sum = cpu_ctz(top);
+
+        u32 summary_word = summary[sum];
+        if (summary_word == 0) {
+            /* Set the bit again if a block was freed in the meantime */
+            atomic_clear_bit(&desc->top, sum);
+            if (summary[sum]) {
+                atomic_set_bit(&desc->top, sum);
+            }
+            continue;
+        }
+        u32 word = (sum * 32) + cpu_ctz(summary_word);
+        volatile u32* bitmap = &desc->bitmap[word];
+
+        /* Take the first free block in the word */
+        u32 value;
+        u32 bit;
+        do {
+            value = ldrex(bitmap);
+            if (value == 0) {
+                break;
+            }
+            bit = cpu_ctz(value);
+        } while (strex(bitmap, value & ~(1 << bit)));
+
+        if (value == 0) {
+            atomic_clear_bit(&summary[sum], word % 32);
+            if (*bitmap) {
+                atomic_set_bit(&summary[sum], word % 32);
+            }
+            continue;
+        }
+
+        atomic_add(&desc->used_blocks, 1);
+        return index_to_addr(desc, (word * 32) + bit);
+    }
+}
+
+/*
+ * Frees a block allocated by `umalloc_isr`
+ */
+void ufree_isr(struct umalloc_desc* desc, void* ptr)
+{
+    u32 index = 0;
+    if (!addr_to_index(desc, ptr, &index)) {
+        panic("bfree failed");
+    }
+    u32 word = index / 32;
+    u32 bit = index % 32;
+    volatile u32* bitmap = &desc->bitmap[word];
+
+    u32 value;
+    do {
+        value = ldrex(bitmap);
+        if (value & (1 << bit)) {
+            panic("bfree failed");
+        }
+    } while (strex(bitmap, value | (1 << bit)));
+
+    atomic_add(&desc->used_blocks, (u32)-1);
+
+    /* The word must be visible in the summary after the block is free */
+    atomic_set_bit(&desc->summary[word / 32], word % 32);
+    atomic_set_bit(&desc->top, word / 32);
 }
 
 u32 umalloc_get_used(struct umalloc_desc* desc)
@@ -2,9 +2,8 @@
 
 /*
  * umalloc is the preferred allocator when the user are allocating small blocks
- * of the same size. This will perform up to 50 times faster allocations than
- * pmalloc and smalloc. An example is URBs which is the main target for this
- * allocator
+ * of the same size. The allocation time does not depend on the number of
+ * blocks. An example is URBs which is the main target for this allocator
  */
 
 #ifndef BMALLOC_H
@@ -13,18 +12,37 @@
 #include "types.h"
 #include "pmalloc.h"
 
+/*
+ * The free blocks are found through a bitmap with one bit per block, and two
+ * summary levels above it. A bit is set in the `summary` if the bitmap word
+ * has a free block, and a bit is set in `top` if the summary word has a bit
+ * set. This limits an allocator to 32 * 32 * 32 blocks
+ */
+#define UMALLOC_MAX_BLOCKS (32 * 32 * 32)
+
+/* Largest block size. This keeps the arena size within 32 bits */
+#define UMALLOC_MAX_BLOCK_SIZE 0x10000
+
 struct umalloc_desc {
     u8* arena;
     u32* bitmap;
+    u32* summary;
+    volatile u32 top;
+
+    /* Bitmap word which is checked first on the next allocation */
+    u32 hint;
 
     /* All allocation will return this many bytes */
     u32 block_size;
     u32 block_count;
 
     /* Keeps track of the memory statistics */
-    u32 used_blocks;
+    volatile u32 used_blocks;
 };
 
+u8 umalloc_try_new(struct umalloc_desc* desc, u32 block_size, u32 block_count,
+    enum pmalloc_bank bank);
+
 void umalloc_new(struct umalloc_desc* desc, u32 block_size, u32 block_count, 
     enum pmalloc_bank bank);
 
@@ -36,6 +54,10 @@ void* ucalloc(struct umalloc_desc* desc);
 
 void ufree(struct umalloc_desc* desc, void* ptr);
 
+void* umalloc_isr(struct umalloc_desc* desc);
+
+void ufree_isr(struct umalloc_desc* desc, void* ptr);
+
 u32 umalloc_get_used(struct umalloc_desc* desc);
 
 #endif
\ No newline at end of file
@@ -6,6 +6,8 @@
 #include "usb_protocol.h"
 #include "memory.h"
 #include "bmalloc.h"
+#include "slab.h"
+#include "panic.h"
 #include "thread.h"
 #include "usb_debug.h"
 #include "config.h"
@@ -53,6 +55,24 @@ static u8 usbc_check_iface_match(const struct usb_dev_id* id, struct usb_iface*
 static u8 usbc_check_driver_match(struct usb_driver* driver, struct usb_iface* iface);
 static struct usb_driver* usbc_find_driver(struct usb_iface* iface, struct usb_core* usbc);
 
+/*
+ * The device is zeroed since the enumeration relies on fields like the
+ * current configuration being cleared
+ */
+static void usbc_dev_ctor(void* obj)
+{
+    memory_fill(obj, 0x00, sizeof(struct usb_dev));
+}
+
+/*
+ * USB devices and their descriptor buffers are allocated from slab caches
+ */
+static struct slab_cache usb_dev_cache = SLAB_CACHE_INIT("usb_dev",
+    sizeof(struct usb_dev), USB_SLAB_OBJECTS, USB_CACHE_BANK, usbc_dev_ctor);
+
+static struct slab_cache usb_desc_cache = SLAB_CACHE_INIT("usb_desc",
+    USB_DESC_CACHE_SIZE, USB_SLAB_OBJECTS, USB_CACHE_BANK, NULL);
+
 /*
  * This will take in a URB an perform a get device descriptor request. Full 
  * specifies if the full descriptor is fetched or only the first 8 bytes. This
@@ -424,8 +444,11 @@ static void usbc_delete_address(struct usb_core* usbc, u8 address)
  */
 static struct usb_dev* usbc_add_device(struct usb_core* usbc)
 {
-    struct usb_dev* dev = (struct usb_dev *)
-        bmalloc(sizeof(struct usb_dev), BMALLOC_SRAM);
+    /* The cache can not grow in an exception handler */
+    struct usb_dev* dev = (struct usb_dev *)slab_alloc(&usb_dev_cache);
+    if (dev == NULL) {
+        dev = (struct usb_dev *)bcalloc(sizeof(struct usb_dev), BMALLOC_SRAM);
+    }
 
     list_add_first(&dev->node, &usbc_private->dev_list);
     usbc->enum_dev = dev;
@@ -525,7 +548,16 @@ static u8 usbc_alloc_descriptors(struct usb_dev* dev, u32 configs, u32 ifaces, u
                         ifaces * sizeof(struct usb_iface) + 
                         eps * sizeof(struct usb_ep);
 
-    dev->configs = (struct usb_config *)bmalloc(desc_mem_size, BMALLOC_SRAM);
+    dev->configs = NULL;
+    if (desc_mem_size <= USB_DESC_CACHE_SIZE) {
+        dev->configs = (struct usb_config *)slab_alloc(&usb_desc_cache);
+    }
+    dev->desc_in_cache = (dev->configs) ? 1 : 0;
+
+    if (dev->configs == NULL) {
+        dev->configs = (struct usb_config *)bmalloc(desc_mem_size,
+            BMALLOC_SRAM);
+    }
     dev->desc_total_size = desc_mem_size;
 
     return (dev->configs) ? 1 : 0;
@@ -537,7 +569,11 @@ static u8 usbc_alloc_descriptors(struct usb_dev* dev, u32 configs, u32 ifaces, u
  */
 static void usbc_delete_descriptors(struct usb_dev* dev)
 {
-    bfree(dev->configs);
+    if (dev->desc_in_cache) {
+        slab_free(dev->configs);
+    } else {
+        bfree(dev->configs);
+    }
 
     dev->configs = NULL;
     dev->desc_total_size = 0;
@@ -830,6 +866,13 @@ void usbc_init(struct usb_core* usbc, struct usbhc* usbhc)
     /* Initialize the driver list */
     list_init(&usbc->driver_list);
 
+    /*
+     * Devices are added from the enumeration callbacks. These might run in
+     * exception handlers, which can not grow the caches
+     */
+    slab_cache_reserve(&usb_dev_cache, USB_DEV_MAX_COUNT);
+    slab_cache_reserve(&usb_desc_cache, USB_DEV_MAX_COUNT);
+
     usbhc_add_root_hub_callback(usbhc, &root_hub_event);
     usbhc_add_sof_callback(usbhc, &sof_event);
 }
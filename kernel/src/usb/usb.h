@@ -86,6 +86,9 @@ struct usb_dev {
     /* Hold the total size of all descriptors */
     u32 desc_total_size;
 
+    /* Set if the descriptors are in the descriptor cache */
+    u8 desc_in_cache;
+
     /* Contains all subconfigurations */
     struct usb_config* configs;
     u32 num_configs;
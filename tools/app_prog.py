@@ -15,6 +15,7 @@ class flasher:
     CMD_ALLOCATE_MEM = 0x01
     CMD_BINARY       = 0x02
     CMD_BINARY_LAST  = 0x03
+    CMD_MEM_STATS    = 0x04
 
     def __init__(self):
         pass
@@ -26,12 +27,20 @@ class flasher:
                             help="Specify the com port COMx or /dev/ttySx")
 
         parser.add_argument("-f", "--file",
-                            required=True,
                             help="Specifies the binary")
 
+        parser.add_argument("-s", "--stats",
+                            action="store_true",
+                            help="Print the kernel memory statistics to " +
+                                 "the console")
+
         args = parser.parse_args()
 
+        if not args.file and not args.stats:
+            parser.error("either -f or -s is required")
+
         self.file = args.file;
+        self.stats = args.stats;
         self.com_port = args.com_port;
 
     def serial_open(self):
@@ -145,7 +154,22 @@ class flasher:
 
         print("Application download complete!")
 
+    def mem_stats(self):
+        self.serial_open()
+
+        # The statistics are printed on the kernel console
+        response = self.send_frame(self.CMD_MEM_STATS, bytearray(1))
+
+        if response != b'\x00':
+            print("Response includes errors: ", response)
+            sys.exit()
+
+        self.serial_close()
+
 # Run the functions
 test = flasher()
 test.parser()
-test.bin_programmer()
\ No newline at end of file
+if test.stats:
+    test.mem_stats()
+else:
+    test.bin_programmer()
\ No newline at end of file
@@ -0,0 +1,153 @@
+import argparse
+import re
+import sys
+
+
+class syscall_gen:
+
+    SYSCALL_PATTERN = re.compile(r"SYSCALL\(\s*(\d+)\s*,\s*(\w+)\s*,\s*" +
+                                 r"(\w+)\s*,\s*([\w\s\*]+?)\s*,\s*" +
+                                 r"\((.*)\)\s*\)")
+
+    VERSION_PATTERN = re.compile(r"#define\s+SYSCALL_ABI_VERSION\s+(\d+)")
+
+    DEFINE_PATTERN = re.compile(r"#define\s+(SYSCALL_(ERROR|NO_WAIT|" +
+                                r"WAIT_FOREVER))\s+(\w+)")
+
+    def __init__(self):
+        self.syscalls = []
+        self.defines = []
+        self.version = None
+
+    def parser(self):
+        parser = argparse.ArgumentParser(description="Generates the " +
+            "application system call stubs from the kernel syscall ABI")
+
+        parser.add_argument("-f", "--file",
+                            default="../kernel/src/kernel/syscall_abi.h",
+                            help="Kernel syscall ABI header")
+
+        parser.add_argument("-o", "--output",
+                            default="../apps/template/src/syscall.h",
+                            help="Output stub header")
+
+        args = parser.parse_args()
+
+        self.file = args.file
+        self.output = args.output
+
+    def load(self):
+        with open(self.file, "r") as f:
+            text = f.read()
+
+        version = self.VERSION_PATTERN.search(text)
+        if version is None:
+            print("No SYSCALL_ABI_VERSION in " + self.file)
+            sys.exit(1)
+        self.version = int(version.group(1))
+
+        for match in self.DEFINE_PATTERN.finditer(text):
+            self.defines.append((match.group(1), match.group(3)))
+
+        numbers = set()
+        for match in self.SYSCALL_PATTERN.finditer(text):
+            nr = int(match.group(1))
+            if nr in numbers:
+                print("Syscall number " + str(nr) + " is used twice")
+                sys.exit(1)
+            numbers.add(nr)
+
+            params = [p.strip() for p in match.group(5).split(",")]
+            if params == ["void"]:
+                params = []
+            if len(params) > 4:
+                print("Syscall " + match.group(2) + " has more than four " +
+                      "parameters")
+                sys.exit(1)
+
+            self.syscalls.append((nr, match.group(2),
+                                  match.group(4).replace(" ", ""), params))
+
+    @staticmethod
+    def param_name(param):
+        return re.split(r"[\s\*]", param)[-1]
+
+    def stub(self, nr, name, ret, params):
+        args = ["(u32)" + self.param_name(p) for p in params]
+        args += ["0"] * (4 - len(args))
+        call = "syscall_invoke(" + str(nr) + ", " + ", ".join(args) + ")"
+
+        if ret == "void":
+            body = "    " + call + ";\n"
+        elif ret == "u32":
+            body = "    return " + call + ";\n"
+        else:
+            body = "    return (" + ret + ")" + call + ";\n"
+
+        proto = ", ".join(params) if params else "void"
+        return ("static inline " + ret + " syscall_" + name + "(" + proto +
+                ") {\n" + body + "}\n")
+
+    def generate(self):
+        lines = []
+        lines.append("/* Copyright (C) StrawberryHacker */\n")
+        lines.append("/*")
+        lines.append(" * Generated by tools/syscall_gen.py from " +
+                     "kernel/src/kernel/syscall_abi.h")
+        lines.append(" * Do not edit this file. Run the script again when " +
+                     "the ABI changes")
+        lines.append(" */\n")
+        lines.append("#ifndef SYSCALL_H")
+        lines.append("#define SYSCALL_H\n")
+        lines.append("#include \"types.h\"\n")
+        lines.append("#define SYSCALL_ABI_VERSION " + str(self.version))
+        for define, value in self.defines:
+            lines.append("#define " + define + " " + value)
+        lines.append("")
+        lines.append("/*")
+        lines.append(" * The system call number is passed in R12 and the " +
+                     "arguments in R0-R3. A system")
+        lines.append(" * call might run in thread mode and return through " +
+                     "LR, so all registers the")
+        lines.append(" * AAPCS allows a function to change are clobbered")
+        lines.append(" */")
+        lines.append("static inline u32 syscall_invoke(u32 nr, u32 a0, " +
+                     "u32 a1, u32 a2, u32 a3) {")
+        lines.append("    register u32 r0 asm(\"r0\") = a0;")
+        lines.append("    register u32 r1 asm(\"r1\") = a1;")
+        lines.append("    register u32 r2 asm(\"r2\") = a2;")
+        lines.append("    register u32 r3 asm(\"r3\") = a3;")
+        lines.append("    register u32 r12 asm(\"r12\") = nr;\n")
+        lines.append("    asm volatile (\"svc #0\"")
+        lines.append("        : \"+r\" (r0), \"+r\" (r1), \"+r\" (r2), " +
+                     "\"+r\" (r3), \"+r\" (r12)")
+        lines.append("        :")
+        lines.append("        : \"lr\", \"cc\", \"memory\"")
+        lines.append("#ifdef __ARM_FP")
+        lines.append("        , \"d0\", \"d1\", \"d2\", \"d3\", \"d4\", " +
+                     "\"d5\", \"d6\", \"d7\"")
+        lines.append("#endif")
+        lines.append("    );")
+        lines.append("    return r0;")
+        lines.append("}\n")
+
+        for nr, name, ret, params in sorted(self.syscalls):
+            lines.append(self.stub(nr, name, ret, params))
+
+        lines.append("#endif")
+
+        with open(self.output, "w") as f:
+            f.write("\n".join(lines) + "\n")
+
+        print("Generated " + str(len(self.syscalls)) + " syscall stubs " +
+              "into " + self.output)
+
+
+def main():
+    gen = syscall_gen()
+    gen.parser()
+    gen.load()
+    gen.generate()
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,199 @@
+import argparse
+import json
+import struct
+import sys
+
+
+class trace_convert:
+
+    MAGIC = 0x45435254
+
+    HEADER_FORMAT = "<IIII"
+    RECORD_FORMAT = "<IIII"
+    RECORD_SIZE   = 16
+
+    TRACE_SWITCH        = 0
+    TRACE_BLOCK         = 1
+    TRACE_UNBLOCK       = 2
+    TRACE_SLEEP         = 3
+    TRACE_WAKE          = 4
+    TRACE_SYSCALL_ENTRY = 5
+    TRACE_SYSCALL_EXIT  = 6
+
+    INSTANT_NAMES = {
+        TRACE_BLOCK   : "block",
+        TRACE_UNBLOCK : "unblock",
+        TRACE_SLEEP   : "sleep",
+        TRACE_WAKE    : "wake"
+    }
+
+    def __init__(self):
+        self.cpu_freq = 300000000
+        self.records = []
+        self.names = {}
+
+    def parser(self):
+        parser = argparse.ArgumentParser(description="Converts a kernel " +
+            "trace buffer into Chrome trace JSON")
+
+        parser.add_argument("-f", "--file",
+                            required=True,
+                            help="Binary dump of `trace_buffer` or the " +
+                                 "serial output of `trace_dump`")
+
+        parser.add_argument("-o", "--output",
+                            default="trace.json",
+                            help="Output JSON file")
+
+        parser.add_argument("-n", "--name",
+                            action="append",
+                            default=[],
+                            help="Thread name given as tid=name")
+
+        args = parser.parse_args()
+
+        self.file = args.file
+        self.output = args.output
+
+        for name in args.name:
+            tid, _, thread_name = name.partition("=")
+            self.names[int(tid, 0)] = thread_name
+
+    def load_binary(self, data):
+        """
+        A binary dump contains the whole `trace_buffer` structure. The
+        records are stored in a ring so the oldest record is first found
+        at `head` modulo the size when the buffer has wrapped
+        """
+        magic, size, cpu_freq, head = struct.unpack_from(self.HEADER_FORMAT,
+                                                         data, 0)
+        if magic != self.MAGIC:
+            print("Not a trace buffer")
+            sys.exit()
+
+        self.cpu_freq = cpu_freq
+        offset = struct.calcsize(self.HEADER_FORMAT)
+
+        start = max(0, head - size)
+        for i in range(start, head):
+            index = i % size
+            self.records.append(struct.unpack_from(self.RECORD_FORMAT, data,
+                offset + index * self.RECORD_SIZE))
+
+    def load_text(self, text):
+        """
+        The serial dump has a header line starting with `trace` followed by
+        one record per line in hexadecimal, oldest first
+        """
+        found = False
+        for line in text.splitlines():
+            words = line.split()
+            if not words:
+                continue
+
+            if words[0] == "trace":
+                if int(words[1], 16) != self.MAGIC:
+                    print("Not a trace buffer")
+                    sys.exit()
+                self.cpu_freq = int(words[3], 16)
+                self.records = []
+                found = True
+                continue
+
+            if found and len(words) == 4:
+                try:
+                    self.records.append(tuple(int(w, 16) for w in words))
+                except ValueError:
+                    found = False
+
+        if not found:
+            print("No trace found in file")
+            sys.exit()
+
+    def load(self):
+        with open(self.file, "rb") as f:
+            data = f.read()
+
+        if len(data) >= 4 and struct.unpack_from("<I", data)[0] == self.MAGIC:
+            self.load_binary(data)
+        else:
+            self.load_text(data.decode("ascii", errors="ignore"))
+
+    def timestamps(self):
+        """
+        The cycle counter is 32-bit and wraps every few seconds. The
+        records are in order, so a smaller timestamp means it has wrapped
+        """
+        base = 0
+        last = None
+        for record in self.records:
+            timestamp = record[0]
+            if last is not None and timestamp < last:
+                base += 1 << 32
+            last = timestamp
+            yield (base + timestamp) * 1000000.0 / self.cpu_freq
+
+    def thread_name(self, tid):
+        if tid in self.names:
+            return self.names[tid]
+        return "Thread " + str(tid)
+
+    def convert(self):
+        """
+        Every thread gets its own track. The time a thread is switched in
+        is a duration event, syscalls are nested duration events and the
+        other scheduler events are instant events
+        """
+        events = []
+        running = None
+        tids = set()
+
+        for us, record in zip(self.timestamps(), self.records):
+            _, event, tid, arg = record
+
+            if event == self.TRACE_SWITCH:
+                if running is not None:
+                    events.append({"name" : "running", "ph" : "E",
+                                   "pid" : 0, "tid" : running, "ts" : us})
+                running = arg
+                tids.add(arg)
+                events.append({"name" : "running", "ph" : "B", "pid" : 0,
+                               "tid" : arg, "ts" : us})
+
+            elif event == self.TRACE_SYSCALL_ENTRY:
+                tids.add(tid)
+                events.append({"name" : "svc " + str(arg), "ph" : "B",
+                               "pid" : 0, "tid" : tid, "ts" : us})
+
+            elif event == self.TRACE_SYSCALL_EXIT:
+                events.append({"name" : "svc " + str(arg), "ph" : "E",
+                               "pid" : 0, "tid" : tid, "ts" : us})
+
+            elif event in self.INSTANT_NAMES:
+                tids.add(tid)
+                instant = {"name" : self.INSTANT_NAMES[event], "ph" : "i",
+                           "s" : "t", "pid" : 0, "tid" : tid, "ts" : us}
+                if event == self.TRACE_SLEEP:
+                    instant["args"] = {"us" : arg * 1000000.0 / self.cpu_freq}
+                events.append(instant)
+
+        for tid in sorted(tids):
+            events.append({"name" : "thread_name", "ph" : "M", "pid" : 0,
+                           "tid" : tid,
+                           "args" : {"name" : self.thread_name(tid)}})
+
+        with open(self.output, "w") as f:
+            json.dump({"traceEvents" : events, "displayTimeUnit" : "ns"}, f)
+
+        print("Converted " + str(len(self.records)) + " records into " +
+              self.output)
+
+
+def main():
+    converter = trace_convert()
+    converter.parser()
+    converter.load()
+    converter.convert()
+
+if __name__ == "__main__":
+    main()